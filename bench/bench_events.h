@@ -0,0 +1,21 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "event_system/event_system.h"
+
+struct KeyPressEvent : public Event {
+    explicit KeyPressEvent(int keyCode) : Event(event_type_id<KeyPressEvent>), key_code(keyCode) { }
+    int key_code;
+};
+struct KeyReleaseEvent : public Event {
+    explicit KeyReleaseEvent(int keyCode) : Event(event_type_id<KeyReleaseEvent>), key_code(keyCode) { }
+    int key_code;
+};
+// event of a given size, for measuring how the payload affects queueing and dispatch
+template<std::size_t Size>
+struct PayloadEvent : public Event {
+    PayloadEvent() : Event(event_type_id<PayloadEvent>) { }
+    std::array<std::byte, Size> payload {};
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+#include "event_system/type_list.h"
+
+// events the benches dispatch, defined in bench_events.h
+struct KeyPressEvent;
+struct KeyReleaseEvent;
+template<std::size_t Size>
+struct PayloadEvent;
+using EventRegistry = TypeList<KeyPressEvent, KeyReleaseEvent, PayloadEvent<8>, PayloadEvent<64>, PayloadEvent<256>, PayloadEvent<1024>>;
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench_events.h"
+
+// Stresses handler churn while events are flowing: every frame destroys and re-creates a share of the live
+// handlers at random positions, pushes a burst of events and processes the queue. With constant-time
+// subscribe/unsubscribe the churn rate should stay flat as the number of live handlers grows.
+
+struct PressHandler : public EventHandler<PressHandler, KeyPressEvent> {
+    bool handle(const Event&) {
+        return false;
+    }
+};
+struct InputHandler : public EventHandler<InputHandler, KeyPressEvent, KeyReleaseEvent> {
+    bool handle(const Event&) {
+        return false;
+    }
+};
+
+static std::unique_ptr<IEventHandler> make_handler(std::mt19937& random) {
+    if (random() & 1) {
+        return std::make_unique<PressHandler>();
+    }
+    return std::make_unique<InputHandler>();
+}
+
+int main() {
+    const std::size_t live_counts[] = { 1000, 10000, 100000 };
+    const std::size_t frames = 200;
+    const std::size_t churn_per_frame = 1000;
+    const std::size_t events_per_frame = 16;
+
+    std::printf("%10s %10s %18s %14s\n", "handlers", "frames", "churn ops/s", "frames/s");
+    for (auto live : live_counts) {
+        std::mt19937 random(42);
+        std::vector<std::unique_ptr<IEventHandler>> handlers;
+        handlers.reserve(live);
+        for (std::size_t i = 0; i < live; i++) {
+            handlers.push_back(make_handler(random));
+        }
+        auto& bus = EventBus::get_instance();
+        std::chrono::steady_clock::duration churn_time {};
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t frame = 0; frame < frames; frame++) {
+            auto churn_start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < churn_per_frame; i++) {
+                // despawn a random handler and spawn a new one, which subscribes at the end of the tables
+                handlers[random() % live] = make_handler(random);
+            }
+            churn_time += std::chrono::steady_clock::now() - churn_start;
+            for (std::size_t i = 0; i < events_per_frame; i++) {
+                bus.push_to_queue(KeyPressEvent(static_cast<int>(i)));
+                bus.push_to_queue(KeyReleaseEvent(static_cast<int>(i)));
+            }
+            bus.process_queue();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto churn_ops = static_cast<double>(frames * churn_per_frame * 2);
+        std::printf("%10zu %10zu %18.0f %14.1f\n", live, frames, churn_ops / std::chrono::duration<double>(churn_time).count(), static_cast<double>(frames) / elapsed);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <queue>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "bench_events.h"
+
+// Measures events per second through EventBus::process_queue for a growing number of handlers,
+// with only a fraction of them (the selectivity) subscribed to the dispatched event type.
+// The "scan" column is the previous dispatch strategy - walk every handler and test its signature.
+
+// the previous strategy also called every handler through a virtual handle()
+struct ScanHandler {
+    virtual ~ScanHandler() = default;
+    virtual bool handle(const Event& event) = 0;
+};
+template<typename T>
+struct CountingHandler : public EventHandler<CountingHandler<T>, T>, public ScanHandler {
+    // final, so the bus's thunk calls it directly
+    bool handle(const Event&) final {
+        m_count++;
+        return false;
+    }
+    std::size_t m_count { 0 };
+};
+
+static double events_per_second(std::size_t events, std::chrono::steady_clock::duration elapsed) {
+    return static_cast<double>(events) / std::chrono::duration<double>(elapsed).count();
+}
+
+static double run_bus(std::size_t events) {
+    auto& bus = EventBus::get_instance();
+    for (std::size_t i = 0; i < events; i++) {
+        bus.push_to_queue(KeyPressEvent(0));
+    }
+    auto start = std::chrono::steady_clock::now();
+    bus.process_queue();
+    return events_per_second(events, std::chrono::steady_clock::now() - start);
+}
+
+struct ScanEntry {
+    std::unique_ptr<ScanHandler> handler;
+    EventSignature signature;
+};
+
+static double run_scan(const std::vector<ScanEntry>& handlers, std::size_t events) {
+    std::queue<KeyPressEvent> queue;
+    for (std::size_t i = 0; i < events; i++) {
+        queue.emplace(0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    while (!queue.empty()) {
+        auto event = queue.front();
+        for (auto& entry : handlers) {
+            if (entry.signature.test(event.get_type())) {
+                if (entry.handler->handle(event)) {
+                    break;
+                }
+            }
+        }
+        queue.pop();
+    }
+    return events_per_second(events, std::chrono::steady_clock::now() - start);
+}
+
+int main() {
+    const std::size_t handler_counts[] = { 16, 256, 4096 };
+    const double selectivities[] = { 0.01, 0.1, 1.0 };
+    // keep the number of handler invocations per run roughly constant
+    const std::size_t invocation_budget = 1 << 24;
+
+    std::printf("%10s %12s %10s %16s %16s\n", "handlers", "selectivity", "events", "bus events/s", "scan events/s");
+    for (auto handler_count : handler_counts) {
+        for (auto selectivity : selectivities) {
+            auto subscribers = static_cast<std::size_t>(static_cast<double>(handler_count) * selectivity);
+            if (subscribers == 0) {
+                subscribers = 1;
+            }
+            std::vector<ScanEntry> handlers;
+            handlers.reserve(handler_count);
+            for (std::size_t i = 0; i < handler_count; i++) {
+                // spread subscribers evenly through the registration order
+                auto subscribed = (i * subscribers) / handler_count != ((i + 1) * subscribers) / handler_count;
+                if (subscribed) {
+                    handlers.push_back({ std::make_unique<CountingHandler<KeyPressEvent>>(), CountingHandler<KeyPressEvent>::signature });
+                } else {
+                    handlers.push_back({ std::make_unique<CountingHandler<KeyReleaseEvent>>(), CountingHandler<KeyReleaseEvent>::signature });
+                }
+            }
+            auto events = invocation_budget / handler_count;
+            auto bus = run_bus(events);
+            auto scan = run_scan(handlers, events);
+            std::printf("%10zu %11.0f%% %10zu %16.0f %16.0f\n", handler_count, selectivity * 100.0, events, bus, scan);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,360 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "bench_events.h"
+
+// Regression suite for the bus, built on Google Benchmark. Run with --benchmark_format=json (or
+// --benchmark_out=<file> --benchmark_out_format=json) to get machine readable results that can be compared
+// across releases, e.g. with tools/compare.py from the Google Benchmark repository.
+
+struct CountingHandler : public EventHandler<CountingHandler, KeyPressEvent> {
+    using EventHandler::EventHandler;
+    bool handle(const Event&) {
+        benchmark::DoNotOptimize(++m_count);
+        return false;
+    }
+    std::size_t m_count { 0 };
+};
+struct IdleHandler : public EventHandler<IdleHandler, KeyReleaseEvent> {
+    using EventHandler::EventHandler;
+    bool handle(const Event&) {
+        return false;
+    }
+};
+// stops propagation for key codes below its threshold, so the key code picks the stop rate
+struct StoppingHandler : public EventHandler<StoppingHandler, KeyPressEvent> {
+    StoppingHandler(EventBus& bus, int threshold) : EventHandler(bus, 1), m_threshold(threshold) { }
+    bool handle(const Event& event) {
+        return static_cast<const KeyPressEvent&>(event).key_code < m_threshold;
+    }
+    int m_threshold;
+};
+
+// handlers on the bus, fan_out percent of them subscribed to the pushed event type and spread evenly
+static std::vector<std::unique_ptr<IEventHandler>> make_handlers(EventBus& bus, std::size_t count, std::size_t fan_out) {
+    auto subscribers = std::max<std::size_t>(count * fan_out / 100, 1);
+    std::vector<std::unique_ptr<IEventHandler>> handlers;
+    handlers.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        if ((i * subscribers) / count != ((i + 1) * subscribers) / count) {
+            handlers.push_back(std::make_unique<CountingHandler>(bus));
+        } else {
+            handlers.push_back(std::make_unique<IdleHandler>(bus));
+        }
+    }
+    return handlers;
+}
+
+// push a burst of events and drain it - the common per frame pattern
+static void BM_PushProcess(benchmark::State& state) {
+    EventBus bus;
+    auto handlers = make_handlers(bus, state.range(0), state.range(1));
+    const std::size_t burst = 256;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            bus.push_to_queue(KeyPressEvent(0));
+        }
+        bus.process_queue();
+    }
+    state.SetItemsProcessed(state.iterations() * burst);
+}
+BENCHMARK(BM_PushProcess)->ArgNames({ "handlers", "fan_out" })->ArgsProduct({ { 1, 16, 256, 4096 }, { 1, 10, 100 } });
+
+// same as BM_PushProcess with the events constructed in the queue
+static void BM_EmplaceProcess(benchmark::State& state) {
+    EventBus bus;
+    auto handlers = make_handlers(bus, state.range(0), state.range(1));
+    const std::size_t burst = 256;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            bus.emplace<KeyPressEvent>(0);
+        }
+        bus.process_queue();
+    }
+    state.SetItemsProcessed(state.iterations() * burst);
+}
+BENCHMARK(BM_EmplaceProcess)->ArgNames({ "handlers", "fan_out" })->ArgsProduct({ { 1, 16, 256 }, { 100 } });
+
+// same as BM_PushProcess on a bounded bus, whose lanes are preallocated rings that just fit the burst
+static void BM_BoundedPushProcess(benchmark::State& state) {
+    const std::size_t burst = 256;
+    EventBus bus(burst, OverflowPolicy::DropNewest);
+    auto handlers = make_handlers(bus, state.range(0), state.range(1));
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            bus.push_to_queue(KeyPressEvent(0));
+        }
+        bus.process_queue();
+    }
+    state.SetItemsProcessed(state.iterations() * burst);
+}
+BENCHMARK(BM_BoundedPushProcess)->ArgNames({ "handlers", "fan_out" })->ArgsProduct({ { 1, 16, 256 }, { 100 } });
+
+// latency of a single event from dispatch to the last handler, without the queue
+static void BM_DispatchNow(benchmark::State& state) {
+    EventBus bus;
+    auto handlers = make_handlers(bus, state.range(0), state.range(1));
+    KeyPressEvent event(0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bus.dispatch_now(event));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DispatchNow)->ArgNames({ "handlers", "fan_out" })->ArgsProduct({ { 1, 16, 256, 4096 }, { 1, 10, 100 } });
+
+// same as BM_DispatchNow with lambdas subscribed through EventBus::subscribe instead of handler objects
+static void BM_DispatchNowCallable(benchmark::State& state) {
+    EventBus bus;
+    auto subscribers = std::max<std::size_t>(state.range(0) * state.range(1) / 100, 1);
+    std::size_t count = 0;
+    std::vector<SubscriptionToken> tokens;
+    for (std::size_t i = 0; i < static_cast<std::size_t>(state.range(0)); i++) {
+        if ((i * subscribers) / state.range(0) != ((i + 1) * subscribers) / state.range(0)) {
+            tokens.push_back(bus.subscribe<KeyPressEvent>([&count](const KeyPressEvent&) {
+                benchmark::DoNotOptimize(++count);
+            }));
+        } else {
+            tokens.push_back(bus.subscribe<KeyReleaseEvent>([](const KeyReleaseEvent&) { }));
+        }
+    }
+    KeyPressEvent event(0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bus.dispatch_now(event));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DispatchNowCallable)->ArgNames({ "handlers", "fan_out" })->ArgsProduct({ { 1, 16, 256, 4096 }, { 1, 10, 100 } });
+
+// share of events (in percent) swallowed by a high priority handler in front of the others
+static void BM_StopPropagation(benchmark::State& state) {
+    EventBus bus;
+    auto handlers = make_handlers(bus, state.range(0), 100);
+    StoppingHandler stopper(bus, static_cast<int>(state.range(1)));
+    const std::size_t burst = 100;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            bus.push_to_queue(KeyPressEvent(static_cast<int>(i)));
+        }
+        bus.process_queue();
+    }
+    state.SetItemsProcessed(state.iterations() * burst);
+}
+BENCHMARK(BM_StopPropagation)->ArgNames({ "handlers", "stop_rate" })->ArgsProduct({ { 16, 256 }, { 0, 10, 50, 100 } });
+
+// counts the payload events it is given
+template<std::size_t Size>
+static SubscriptionToken subscribe_payload(EventBus& bus, std::size_t& count) {
+    return bus.subscribe<PayloadEvent<Size>>([&count](const PayloadEvent<Size>& event) {
+        benchmark::DoNotOptimize(event.payload[0]);
+        count++;
+    });
+}
+
+// push a burst of events of a given size and drain it
+template<std::size_t Size>
+static void BM_PayloadProcess(benchmark::State& state) {
+    EventBus bus;
+    std::size_t count = 0;
+    auto token = subscribe_payload<Size>(bus, count);
+    const std::size_t burst = 256;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            bus.emplace<PayloadEvent<Size>>();
+        }
+        bus.process_queue();
+    }
+    benchmark::DoNotOptimize(count);
+    state.SetItemsProcessed(state.iterations() * burst);
+    state.SetBytesProcessed(state.iterations() * burst * sizeof(PayloadEvent<Size>));
+}
+BENCHMARK_TEMPLATE(BM_PayloadProcess, 8);
+BENCHMARK_TEMPLATE(BM_PayloadProcess, 64);
+BENCHMARK_TEMPLATE(BM_PayloadProcess, 256);
+BENCHMARK_TEMPLATE(BM_PayloadProcess, 1024);
+
+// same as BM_PayloadProcess with the events taken from an EventPool and submitted - the queue only holds pointers
+template<std::size_t Size>
+static void BM_PayloadPooled(benchmark::State& state) {
+    const std::size_t burst = 256;
+    EventPool<PayloadEvent<Size>> pool(burst, PayloadEvent<Size>());
+    EventBus bus;
+    std::size_t count = 0;
+    auto token = subscribe_payload<Size>(bus, count);
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            auto event = pool.acquire();
+            event->payload[0] = std::byte { 1 };
+            bus.submit(event);
+        }
+        bus.process_queue();
+    }
+    benchmark::DoNotOptimize(count);
+    state.SetItemsProcessed(state.iterations() * burst);
+    state.SetBytesProcessed(state.iterations() * burst * sizeof(PayloadEvent<Size>));
+}
+BENCHMARK_TEMPLATE(BM_PayloadPooled, 8);
+BENCHMARK_TEMPLATE(BM_PayloadPooled, 64);
+BENCHMARK_TEMPLATE(BM_PayloadPooled, 256);
+BENCHMARK_TEMPLATE(BM_PayloadPooled, 1024);
+
+// same as BM_PayloadProcess on a multi-producer bus - payloads are capped by the slot size
+template<std::size_t Size>
+static void BM_ConcurrentPayload(benchmark::State& state) {
+    EventBus bus;
+    bus.set_queue_mode(QueueMode::MultiProducer, 1 << 10);
+    std::size_t count = 0;
+    auto token = subscribe_payload<Size>(bus, count);
+    const std::size_t burst = 256;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            bus.emplace<PayloadEvent<Size>>();
+        }
+        bus.process_queue();
+    }
+    benchmark::DoNotOptimize(count);
+    state.SetItemsProcessed(state.iterations() * burst);
+    state.SetBytesProcessed(state.iterations() * burst * sizeof(PayloadEvent<Size>));
+}
+BENCHMARK_TEMPLATE(BM_ConcurrentPayload, 8);
+BENCHMARK_TEMPLATE(BM_ConcurrentPayload, 64);
+
+// producers push from their own threads while the benchmark thread drains the bus
+static void BM_MultiProducer(benchmark::State& state) {
+    EventBus bus;
+    bus.set_queue_mode(QueueMode::MultiProducer);
+    auto handlers = make_handlers(bus, 16, 100);
+    auto producers = static_cast<std::size_t>(state.range(0));
+    const std::size_t per_producer = 1 << 14;
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        threads.reserve(producers);
+        for (std::size_t p = 0; p < producers; p++) {
+            threads.emplace_back([&bus]() {
+                for (std::size_t i = 0; i < per_producer; i++) {
+                    // a full queue is backpressure - retry until the consumer frees a slot
+                    while (!bus.push_to_queue(KeyPressEvent(0))) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        std::size_t processed = 0;
+        while (processed < producers * per_producer) {
+            processed += bus.process_queue(std::numeric_limits<std::size_t>::max());
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * producers * per_producer);
+}
+BENCHMARK(BM_MultiProducer)->ArgName("producers")->RangeMultiplier(2)->Range(1, 16)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// spends a fixed amount of work on every event - a handler heavy enough to be worth another thread
+struct WorkingHandler : public EventHandler<WorkingHandler, KeyPressEvent> {
+    explicit WorkingHandler(EventBus& bus) : EventHandler(bus) {
+        set_execution(HandlerExecution::Parallel);
+    }
+    bool handle(const Event& event) {
+        auto value = static_cast<std::uint64_t>(static_cast<const KeyPressEvent&>(event).key_code);
+        for (std::size_t i = 0; i < 1000; i++) {
+            value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        benchmark::DoNotOptimize(value);
+        return false;
+    }
+};
+
+// independent handlers behind a sequential one that may stop propagation, spread over a growing number of threads
+static void BM_ParallelDispatch(benchmark::State& state) {
+    EventBus bus;
+    bus.set_worker_threads(static_cast<std::size_t>(state.range(0)));
+    StoppingHandler stopper(bus, 0);
+    std::vector<std::unique_ptr<WorkingHandler>> handlers;
+    for (std::size_t i = 0; i < 64; i++) {
+        handlers.push_back(std::make_unique<WorkingHandler>(bus));
+    }
+    const std::size_t burst = 16;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < burst; i++) {
+            bus.push_to_queue(KeyPressEvent(static_cast<int>(i)));
+        }
+        bus.process_queue();
+    }
+    state.SetItemsProcessed(state.iterations() * burst);
+}
+BENCHMARK(BM_ParallelDispatch)->ArgName("threads")->RangeMultiplier(2)->Range(1, 32)->UseRealTime();
+
+// every session event travels on to the next session, which lives on the next shard, until its hops run out.
+// Sessions and hops share the key code, as events must be listed in EventRegistry.
+struct SessionHandler : public EventHandler<SessionHandler, KeyPressEvent> {
+    static constexpr int HOPS = 4;
+    SessionHandler(ShardedEventBus& sharded, std::size_t shard) : EventHandler(sharded.get_shard(shard)), m_sharded(sharded) { }
+    bool handle(const Event& event) {
+        auto code = static_cast<const KeyPressEvent&>(event).key_code;
+        if (code % HOPS != 0) {
+            auto session = code / HOPS + 1;
+            m_sharded.post(static_cast<std::uint64_t>(session), KeyPressEvent(session * HOPS + code % HOPS - 1));
+        }
+        m_handled.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    ShardedEventBus& m_sharded;
+    std::atomic<std::size_t> m_handled { 0 };
+};
+
+// independent sessions spread over a growing number of shards, each event forwarded across shards
+static void BM_ShardedForwarding(benchmark::State& state) {
+    ShardedEventBus sharded(static_cast<std::size_t>(state.range(0)));
+    std::vector<std::unique_ptr<SessionHandler>> handlers;
+    for (std::size_t i = 0; i < sharded.get_shard_count(); i++) {
+        handlers.push_back(std::make_unique<SessionHandler>(sharded, i));
+    }
+    sharded.start();
+    const int sessions = 1 << 12;
+    std::size_t expected = 0;
+    for (auto _ : state) {
+        for (int session = 0; session < sessions; session++) {
+            while (!sharded.post(static_cast<std::uint64_t>(session), KeyPressEvent(session * SessionHandler::HOPS + SessionHandler::HOPS - 1))) {
+                std::this_thread::yield();
+            }
+        }
+        expected += sessions * SessionHandler::HOPS;
+        auto handled = [&]() {
+            std::size_t total = 0;
+            for (auto& handler : handlers) {
+                total += handler->m_handled.load(std::memory_order_relaxed);
+            }
+            return total;
+        };
+        while (handled() < expected) {
+            std::this_thread::yield();
+        }
+    }
+    sharded.stop();
+    state.SetItemsProcessed(static_cast<std::int64_t>(expected));
+}
+BENCHMARK(BM_ShardedForwarding)->ArgName("shards")->RangeMultiplier(2)->Range(1, 16)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// destroy and re-create one handler among many live ones
+static void BM_RegistrationChurn(benchmark::State& state) {
+    EventBus bus;
+    auto handlers = make_handlers(bus, state.range(0), 50);
+    std::size_t next = 0;
+    for (auto _ : state) {
+        handlers[next] = std::make_unique<CountingHandler>(bus);
+        next = (next + 7919) % handlers.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RegistrationChurn)->ArgName("handlers")->RangeMultiplier(10)->Range(100, 100000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "bench_events.h"
+
+// Measures cross-thread push throughput of the lock-free ConcurrentEventQueue used by QueueMode::MultiProducer
+// against a mutex-guarded std::queue. A single consumer drains the queue while the producers push.
+
+struct MutexEventQueue {
+    bool try_push(KeyPressEvent&& event) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.emplace(event);
+        return true;
+    }
+    bool try_pop() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.empty()) {
+            return false;
+        }
+        m_queue.pop();
+        return true;
+    }
+    std::mutex m_mutex;
+    std::queue<KeyPressEvent> m_queue;
+};
+
+struct LockFreeEventQueue {
+    bool try_push(KeyPressEvent&& event) {
+        return m_queue.try_emplace<KeyPressEvent>(std::move(event));
+    }
+    bool try_pop() {
+        if (m_queue.front() == nullptr) {
+            return false;
+        }
+        m_queue.pop();
+        return true;
+    }
+    ConcurrentEventQueue m_queue { 1 << 14 };
+};
+
+template<typename Queue>
+static double run(std::size_t producers, std::size_t events) {
+    Queue queue;
+    auto per_producer = events / producers;
+    auto total = per_producer * producers;
+    std::vector<std::thread> threads;
+    threads.reserve(producers);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, per_producer]() {
+            for (std::size_t i = 0; i < per_producer; i++) {
+                // a full queue is backpressure - retry until the consumer frees a slot
+                while (!queue.try_push(KeyPressEvent(0))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::size_t consumed = 0;
+    while (consumed < total) {
+        if (queue.try_pop()) {
+            consumed++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(total) / elapsed;
+}
+
+int main() {
+    const std::size_t producer_counts[] = { 1, 4, 16, 64 };
+    const std::size_t events = 1 << 21;
+
+    std::printf("%10s %10s %18s %18s\n", "producers", "events", "lock-free events/s", "mutex events/s");
+    for (auto producers : producer_counts) {
+        auto lock_free = run<LockFreeEventQueue>(producers, events);
+        auto mutex = run<MutexEventQueue>(producers, events);
+        std::printf("%10zu %10zu %18.0f %18.0f\n", producers, events, lock_free, mutex);
+    }
+    return 0;
+}
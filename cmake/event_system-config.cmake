@@ -0,0 +1,4 @@
+# the headers start threads - consumers get Threads::Threads through event_system::event_system
+include(CMakeFindDependencyMacro)
+find_dependency(Threads)
+include("${CMAKE_CURRENT_LIST_DIR}/event_system-targets.cmake")
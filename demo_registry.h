@@ -0,0 +1,8 @@
+#pragma once
+
+#include "event_system/type_list.h"
+
+// events of the example in main.cpp, see EVENT_SYSTEM_REGISTRY in event.h
+struct KeyPressEvent;
+struct KeyReleaseEvent;
+using EventRegistry = TypeList<KeyPressEvent, KeyReleaseEvent>;
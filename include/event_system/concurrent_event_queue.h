@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "event_slot.h"
+
+// Bounded lock-free multi-producer single-consumer queue of events. Producers claim a slot with a CAS on the
+// enqueue position and publish it through the slot's sequence number, so they never wait on each other or on
+// the consumer. Events are moved into fixed-size inline slots - there is no allocation after construction.
+struct ConcurrentEventQueue {
+    public:
+        explicit ConcurrentEventQueue(std::size_t capacity) : m_mask(capacity - 1), m_slots(new Slot[capacity]) {
+            assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "Capacity must be a power of two");
+            for (std::size_t i = 0; i < capacity; i++) {
+                m_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        ConcurrentEventQueue(ConcurrentEventQueue const&) = delete;
+        void operator=(ConcurrentEventQueue const&) = delete;
+        ~ConcurrentEventQueue() {
+            while (front() != nullptr) {
+                pop();
+            }
+        }
+        // safe to call from any thread - returns false (and drops the event) if the queue is full
+        template<typename T, typename... Args>
+        bool try_emplace(Args&&... args) {
+            std::size_t position;
+            auto slot = claim(position);
+            if (slot == nullptr) {
+                return false;
+            }
+            slot->event.template emplace<T>(std::forward<Args>(args)...);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+        // safe to call from any thread - queues a pointer to an event stored elsewhere, see EventSlot::hold. Returns
+        // false if the queue is full.
+        bool try_push(Event& event, EventRelease release) {
+            std::size_t position;
+            auto slot = claim(position);
+            if (slot == nullptr) {
+                return false;
+            }
+            slot->event.hold(event, release);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+        // consumer only - the next published event, or nullptr if there is none
+        [[nodiscard]] inline Event* front() {
+            auto& slot = m_slots[m_dequeue & m_mask];
+            if (slot.sequence.load(std::memory_order_acquire) != m_dequeue + 1) {
+                return nullptr;
+            }
+            return &slot.event.get_event();
+        }
+        // consumer only - number of slots claimed so far and not yet popped, some of which may not be published yet
+        [[nodiscard]] inline std::size_t pending() const {
+            return m_enqueue.load(std::memory_order_acquire) - m_dequeue;
+        }
+        // consumer only - release the event returned by front()
+        void pop() {
+            auto& slot = m_slots[m_dequeue & m_mask];
+            slot.event.release();
+            slot.sequence.store(m_dequeue + m_mask + 1, std::memory_order_release);
+            m_dequeue++;
+        }
+    private:
+        struct alignas(64) Slot {
+            std::atomic<std::size_t> sequence;
+            EventSlot event;
+        };
+        // reserves the slot at the enqueue position for the caller to publish, or returns nullptr if it is full
+        Slot* claim(std::size_t& position) {
+            position = m_enqueue.load(std::memory_order_relaxed);
+            while (true) {
+                auto slot = &m_slots[position & m_mask];
+                auto sequence = slot->sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+                if (difference == 0) {
+                    if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        return slot;
+                    }
+                } else if (difference < 0) {
+                    // the consumer has not freed this slot yet
+                    return nullptr;
+                } else {
+                    position = m_enqueue.load(std::memory_order_relaxed);
+                }
+            }
+        }
+    private:
+        const std::size_t m_mask;
+        std::unique_ptr<Slot[]> m_slots;
+        // producers and the consumer write to separate cache lines
+        alignas(64) std::atomic<std::size_t> m_enqueue { 0 };
+        alignas(64) std::size_t m_dequeue { 0 };
+};
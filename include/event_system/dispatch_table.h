@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "event.h"
+#include "event_bus_interface.h"
+#include "instrumentation.h"
+
+// subscribers of one event type, highest priority first and in registration order within a priority. The order
+// is established on registration, so dispatch never sorts. Unsubscribing leaves a hole that dispatch skips,
+// and holes are compacted away (outside of dispatch) once they make up half of the table.
+struct DispatchTable {
+    // the only array dispatch reads - unsubscribed entries are HandlerDelegate::hole()
+    std::vector<HandlerDelegate> entries {};
+    // subscription owning each entry and its priority - only touched on registration, compaction and batch dispatch
+    std::vector<Subscription*> owners {};
+    std::vector<HandlerPriority> priorities {};
+    std::size_t holes { 0 };
+};
+
+
+// per event type: a contiguous array of its queued events, handed to the type's subscribers in one call
+template<typename List>
+struct EventBatches;
+template<typename... Ts>
+struct EventBatches<TypeList<Ts...>> {
+    public:
+        // move a queued event into the batch of its concrete type
+        inline void gather(Event& event) {
+            GATHER[event.get_type()](*this, event);
+        }
+        // hand each non-empty batch to its handlers, in registry order, then empty the batches (keeping their capacity).
+        // `table(type)` returns the dispatch table of a type right before its batch, and `connected(table, index)`
+        // tells whether an entry still is to be called.
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+        // handlers that disconnect during their batch have the call recorded in the per type totals of `stats`
+        template<typename Table, typename Connected>
+        void dispatch(Table&& table, Connected&& connected, DispatchStats& stats) {
+            (dispatch<Ts>(table, connected, stats.event_types[event_type_id<Ts>].calls), ...);
+        }
+#else
+        template<typename Table, typename Connected>
+        void dispatch(Table&& table, Connected&& connected) {
+            (dispatch<Ts>(table, connected), ...);
+        }
+#endif
+    private:
+        template<typename T>
+        static void gather_as(EventBatches& batches, Event& event) {
+            std::get<std::vector<T>>(batches.m_events).push_back(std::move(static_cast<T&>(event)));
+        }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+        template<typename T, typename Table, typename Connected>
+        void dispatch(Table& tableOf, Connected& connected, HandlerCallStats& departed) {
+#else
+        template<typename T, typename Table, typename Connected>
+        void dispatch(Table& tableOf, Connected& connected) {
+#endif
+            auto& events = std::get<std::vector<T>>(m_events);
+            if (events.empty()) {
+                return;
+            }
+            DispatchTable& table = tableOf(event_type_id<T>);
+            // handlers subscribed during dispatch only see the next batch
+            auto count = table.entries.size();
+            for (std::size_t i = 0; i < count; i++) {
+                if (!connected(table, i)) {
+                    continue;
+                }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+                auto start = std::chrono::steady_clock::now();
+#endif
+                auto handler = static_cast<IBatchHandler<T>*>(table.owners[i]->batch_handler);
+                if (handler == nullptr) {
+                    // no batch entry point - hand the events over one by one
+                    for (const auto& event : events) {
+                        table.entries[i](event);
+                    }
+                } else {
+                    handler->handle_batch(std::span<const T>(events));
+                }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+                // the owner is gone if the handler disconnected during its batch
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                (connected(table, i) ? table.owners[i]->stats : departed).record(elapsed, false);
+#endif
+            }
+            events.clear();
+        }
+    private:
+        // indexed by type id - the registry order is the type id order
+        static constexpr std::array<void (*)(EventBatches&, Event&), sizeof...(Ts)> GATHER { &gather_as<Ts>... };
+        std::tuple<std::vector<Ts>...> m_events {};
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "type_list.h"
+
+// every event type known to the bus comes from the application. EVENT_SYSTEM_REGISTRY names a header that
+// declares them and lists them as `using EventRegistry = TypeList<...>;` - an event's type id is its position in
+// that list. The events themselves derive from Event and are defined after this header.
+#ifndef EVENT_SYSTEM_REGISTRY
+#error "Define EVENT_SYSTEM_REGISTRY as the header listing the application's events in EventRegistry"
+#endif
+#include EVENT_SYSTEM_REGISTRY
+
+using EventTypeId = std::uint32_t;
+constexpr std::size_t EVENT_TYPE_COUNT = EventRegistry::size;
+template<typename T>
+constexpr EventTypeId event_type_id = static_cast<EventTypeId>(TypeIndex<T, EventRegistry>::value);
+
+// set of event types a handler is subscribed to - one bit per registered event type, however many there are
+struct EventSignature {
+    public:
+        template<typename... Ts>
+        static constexpr EventSignature of() {
+            EventSignature signature;
+            (signature.set(event_type_id<Ts>), ...);
+            return signature;
+        }
+        constexpr void set(EventTypeId type) {
+            m_words[type / 64] |= std::uint64_t { 1 } << (type % 64);
+        }
+        [[nodiscard]] constexpr bool test(EventTypeId type) const {
+            return (m_words[type / 64] >> (type % 64)) & 1;
+        }
+        [[nodiscard]] constexpr std::size_t count() const {
+            std::size_t count = 0;
+            for (EventTypeId type = 0; type < EVENT_TYPE_COUNT; type++) {
+                count += test(type);
+            }
+            return count;
+        }
+    private:
+        std::array<std::uint64_t, (EVENT_TYPE_COUNT + 63) / 64> m_words {};
+};
+
+
+struct Event {
+    explicit Event(EventTypeId type) : m_type(type) { }
+    [[nodiscard]] inline EventTypeId get_type() const {
+        return m_type;
+    }
+    template<typename T>
+    [[nodiscard]] inline bool is_type() const {
+        return m_type == event_type_id<T>;
+    }
+    private:
+        EventTypeId m_type;
+};
@@ -0,0 +1,1129 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "concurrent_event_queue.h"
+#include "dispatch_table.h"
+#include "event.h"
+#include "event_bus_interface.h"
+#include "event_pool.h"
+#include "event_ring.h"
+#include "event_stream.h"
+#include "instrumentation.h"
+#include "node_pool.h"
+#include "work_stealing_pool.h"
+
+// a callable subscribed with EventBus::subscribe. Records are pooled by the bus and small callables are stored
+// inline, so subscribing a lambda does not allocate once the pool is warm.
+struct Listener {
+    static constexpr std::size_t BUFFER_SIZE = 48;
+    // batch_handler stays null - batched dispatch calls the callable once per event
+    Subscription subscription {};
+    // points into `buffer`, or at a heap copy when the callable is too large or cannot be moved without throwing
+    void* callable { nullptr };
+    void (*destroy)(void* callable) { nullptr };
+    alignas(std::max_align_t) std::byte buffer[BUFFER_SIZE];
+};
+struct EventBus;
+// owns a subscription made with EventBus::subscribe and unsubscribes when destroyed or reset. Must not outlive
+// its bus. It may be reset from inside its own callable - the callable is destroyed once dispatch is over.
+struct SubscriptionToken {
+    public:
+        SubscriptionToken() = default;
+        SubscriptionToken(SubscriptionToken&& other) noexcept
+            : m_bus(std::exchange(other.m_bus, nullptr)), m_listener(std::exchange(other.m_listener, nullptr)) { }
+        SubscriptionToken& operator=(SubscriptionToken&& other) noexcept {
+            if (this != &other) {
+                reset();
+                m_bus = std::exchange(other.m_bus, nullptr);
+                m_listener = std::exchange(other.m_listener, nullptr);
+            }
+            return *this;
+        }
+        ~SubscriptionToken() {
+            reset();
+        }
+        inline void reset();
+        [[nodiscard]] inline bool is_subscribed() const {
+            return m_listener != nullptr;
+        }
+    private:
+        friend struct EventBus;
+        SubscriptionToken(EventBus& bus, Listener* listener) : m_bus(&bus), m_listener(listener) { }
+    private:
+        EventBus* m_bus { nullptr };
+        Listener* m_listener { nullptr };
+};
+
+
+enum class QueueMode {
+    // push_to_queue and process_queue are called from the same thread
+    SingleThreaded,
+    // push_to_queue may be called from any thread, process_queue from a single consumer thread
+    MultiProducer
+};
+// every priority has its own queue lane. process_queue drains the lanes in this order
+enum class EventPriority : std::uint8_t {
+    Critical,
+    High,
+    Normal,
+    Low
+};
+constexpr std::size_t EVENT_PRIORITY_COUNT = 4;
+// what push_to_queue does with an event whose type already has an event waiting in the same lane
+enum class CoalescePolicy {
+    // queue every event
+    None,
+    // overwrite the waiting event, which keeps its place in the queue
+    KeepLast
+};
+// what a bounded bus does with an event pushed onto a full lane, see EventBus(capacity, overflow). The
+// multi-producer queue can neither drop its oldest event nor grow - unless it blocks, it drops the pushed event.
+enum class OverflowPolicy {
+    // wait until the consumer makes room - multi-producer mode only, a single thread cannot wait for itself
+    Block,
+    // drop the lane's oldest event. While handlers run the oldest may be the one being dispatched, so the pushed
+    // event is dropped instead
+    DropOldest,
+    // drop the pushed event
+    DropNewest,
+    // keep events beyond the ring in heap blocks until the lane has drained - memory is no longer bounded
+    Grow
+};
+
+
+struct EventBus : public IEventBus {
+    public:
+        // returns false if the event was dropped because its lane is full, see OverflowPolicy
+        template<typename T>
+        bool push_to_queue(T&& event, EventPriority priority = EventPriority::Normal) {
+            return emplace<std::decay_t<T>>(priority, std::forward<T>(event));
+        }
+        // constructs a T from `args` right in the queue's storage - the event is never copied or moved on its way to
+        // the handlers. Returns false if it was dropped because its lane is full, see OverflowPolicy. Events
+        // larger than an EventSlot are rejected in multi-producer mode and on a bounded bus that does not grow -
+        // submit those from an EventPool.
+        template<typename T, typename... Args>
+        bool emplace(Args&&... args) {
+            return emplace<T>(EventPriority::Normal, std::forward<Args>(args)...);
+        }
+        template<typename T, typename... Args>
+        bool emplace(EventPriority priority, Args&&... args) {
+            auto& lane = m_lanes[static_cast<std::size_t>(priority)];
+            if (m_mode == QueueMode::MultiProducer) {
+                if constexpr (EventSlot::fits<T>) {
+                    return try_concurrent([&]() {
+                        return lane.concurrent->try_emplace<T>(std::forward<Args>(args)...);
+                    });
+                } else {
+                    assert(false && "Event is too large for a concurrent queue slot - submit it from an EventPool");
+                    return false;
+                }
+            }
+            if constexpr (!EventSlot::fits<T>) {
+                // only a growing bus has somewhere else to put it - reject it before the overflow policy evicts
+                // anything to make room it could not use
+                if (lane.ring != nullptr && m_overflow != OverflowPolicy::Grow) {
+                    assert(false && "Event is too large for a ring slot - submit it from an EventPool");
+                    m_dropped++;
+                    return false;
+                }
+            }
+            // a full ring leaves the arguments alone, so the event can be placed again
+            auto place = [&](auto& queue) -> Event* {
+                if constexpr (std::is_same_v<std::decay_t<decltype(queue)>, EventStream>) {
+                    return &queue.template emplace<T>(std::forward<Args>(args)...);
+                } else if constexpr (EventSlot::fits<T>) {
+                    return queue.template try_emplace<T>(std::forward<Args>(args)...);
+                } else {
+                    return nullptr;
+                }
+            };
+            constexpr auto type = event_type_id<T>;
+            auto& merge = m_coalescing[type];
+            if (!merge) {
+                return enqueue(lane, place) != nullptr;
+            }
+            auto& waiting = lane.waiting[type];
+            if (waiting == nullptr) {
+                waiting = enqueue(lane, place);
+                return waiting != nullptr;
+            }
+            if constexpr (sizeof...(Args) == 1 && (std::is_same_v<Args, T> && ...)) {
+                // a pushed temporary merges as it is
+                merge(*waiting, std::move(args)...);
+            } else {
+                T incoming(std::forward<Args>(args)...);
+                merge(*waiting, std::move(incoming));
+            }
+            return true;
+        }
+        // queues an event acquired from an EventPool<T> without copying it - it goes back to the pool once dispatched
+        // or merged into a waiting one. Returns false, leaving the event with the caller, if it was dropped because
+        // its lane is full.
+        template<typename T>
+        bool submit(T* event, EventPriority priority = EventPriority::Normal) {
+            auto& lane = m_lanes[static_cast<std::size_t>(priority)];
+            if (m_mode == QueueMode::MultiProducer) {
+                return try_concurrent([&]() {
+                    return lane.concurrent->try_push(*event, &EventPool<T>::recycle);
+                });
+            }
+            auto place = [&](auto& queue) -> Event* {
+                if constexpr (std::is_same_v<std::decay_t<decltype(queue)>, EventStream>) {
+                    return &queue.push(*event, &EventPool<T>::recycle);
+                } else {
+                    return queue.try_push(*event, &EventPool<T>::recycle);
+                }
+            };
+            auto type = event->get_type();
+            if (!m_coalescing[type]) {
+                return enqueue(lane, place) != nullptr;
+            }
+            auto& waiting = lane.waiting[type];
+            if (waiting == nullptr) {
+                waiting = enqueue(lane, place);
+                return waiting != nullptr;
+            }
+            m_coalescing[type](*waiting, std::move(*event));
+            EventPool<T>::recycle(event);
+            return true;
+        }
+        // collapse events of type T that pile up before dispatch, see CoalescePolicy. Only single-threaded pushes
+        // are coalesced.
+        template<typename T>
+        void set_coalescing(CoalescePolicy policy) {
+            if (policy == CoalescePolicy::None) {
+                m_coalescing[event_type_id<T>] = nullptr;
+            } else {
+                set_coalescing<T>([](T& waiting, T&& incoming) {
+                    waiting = std::move(incoming);
+                });
+            }
+        }
+        // collapse events of type T that pile up before dispatch by merging each new one into the waiting one with
+        // `merge(T& waiting, T&& incoming)`. The waiting event keeps its place in the queue.
+        template<typename T, typename Merge>
+        requires std::is_invocable_v<Merge, T&, T&&>
+        void set_coalescing(Merge merge) {
+            m_coalescing[event_type_id<T>] = [merge = std::move(merge)](Event& waiting, Event&& incoming) mutable {
+                merge(static_cast<T&>(waiting), static_cast<T&&>(incoming));
+            };
+        }
+        // dispatches every queued event. process_queue and its overloads are not reentrant - called from a handler
+        // they return right away without dispatching anything, and the running call goes on with the queue.
+        void process_queue() override {
+            if (m_draining || !has_subscribers()) {
+                return;
+            }
+            m_draining = true;
+            begin_dispatch();
+            drain([this](Event& event) {
+                pass_quiescent_point();
+                dispatch(event);
+            });
+            finish_dispatch();
+            m_draining = false;
+        }
+        // runs the handlers of the event's type right away, bypassing the queue. Returns true if a handler
+        // stopped propagation.
+        bool dispatch_now(const Event& event) override {
+            begin_dispatch();
+            auto stopped = dispatch(event);
+            finish_dispatch();
+            return stopped;
+        }
+        // dispatches at most `maxEvents` events and returns how many were dispatched - the rest stay queued
+        std::size_t process_queue(std::size_t maxEvents) {
+            return process_queue(maxEvents, std::chrono::steady_clock::time_point::max());
+        }
+        // dispatches events until `budget` has elapsed and returns how many were dispatched - the rest stay queued.
+        // The clock is read every DEADLINE_CHECK_INTERVAL events, so a single slow handler can overrun the budget.
+        std::size_t process_queue(std::chrono::steady_clock::duration budget) {
+            return process_queue(std::numeric_limits<std::size_t>::max(), std::chrono::steady_clock::now() + budget);
+        }
+        std::size_t process_queue(std::size_t maxEvents, std::chrono::steady_clock::time_point deadline) {
+            if (m_draining || !has_subscribers()) {
+                return 0;
+            }
+            m_draining = true;
+            begin_dispatch();
+            auto processed = drain([this](Event& event) {
+                pass_quiescent_point();
+                dispatch(event);
+            }, maxEvents, deadline);
+            finish_dispatch();
+            m_draining = false;
+            return processed;
+        }
+        // dispatches every queued event grouped by type - each batch handler is called once per type with all
+        // of its events. Batches are independent, so stop propagation does not apply. Events pushed by
+        // batch handlers are left for the next call. Not reentrant either, see process_queue.
+        void process_queue_batched() {
+            if (m_draining || !has_subscribers()) {
+                return;
+            }
+            m_draining = true;
+            drain([this](Event& event) {
+                m_batches.gather(event);
+            });
+            begin_dispatch();
+            // every batch reads the tables anew - the batch before it is over, so it is a quiescent point
+            auto table = [this](EventTypeId type) -> DispatchTable& {
+                pass_quiescent_point();
+                return table_of(type);
+            };
+            auto connected = [this](const DispatchTable& table, std::size_t index) {
+                return is_connected(table, index);
+            };
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+            m_batches.dispatch(table, connected, m_stats);
+#else
+            m_batches.dispatch(table, connected);
+#endif
+            finish_dispatch();
+            m_draining = false;
+        }
+        // `capacity` is the size of each multi-producer lane - a bounded bus ignores it and keeps its own, so the lane
+        // is full, and the overflow policy applies, at the same point in both modes. Must be called while no events
+        // are queued and before any producer thread starts pushing.
+        void set_queue_mode(QueueMode mode, std::size_t capacity = DEFAULT_CONCURRENT_CAPACITY) {
+            assert(is_drained() && "Queue mode can only change while the queue is empty");
+            assert((m_overflow != OverflowPolicy::Block || mode == QueueMode::MultiProducer) && "Only a multi-producer bus can block");
+            auto concurrent = mode == QueueMode::MultiProducer;
+            for (auto& lane : m_lanes) {
+                lane.concurrent = concurrent ? std::make_unique<ConcurrentEventQueue>(m_capacity > 0 ? m_capacity : capacity) : nullptr;
+                // the rings are only used by single-threaded pushes
+                if (concurrent || m_capacity == 0) {
+                    lane.ring = nullptr;
+                } else if (lane.ring == nullptr) {
+                    lane.ring = std::make_unique<EventRing>(m_capacity);
+                }
+            }
+            m_mode = mode;
+        }
+        [[nodiscard]] inline QueueMode get_queue_mode() const {
+            return m_mode;
+        }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+        // copy of everything recorded since construction or the last reset_stats. With concurrent registration, call it
+        // and reset_stats from the dispatching thread or while nobody dispatches.
+        [[nodiscard]] DispatchStats get_stats() const {
+            std::unique_lock lock(m_registration_mutex, std::defer_lock);
+            if (m_concurrent_registration) {
+                lock.lock();
+            }
+            auto stats = m_stats;
+            for (EventTypeId type = 0; type < EVENT_TYPE_COUNT; type++) {
+                fold(stats.event_types[type].calls, m_departed[type]);
+                auto& table = table_of(type);
+                for (std::size_t i = 0; i < table.entries.size(); i++) {
+                    if (table.owners[i] != nullptr) {
+                        stats.handlers.push_back({ table.entries[i].object, type, table.owners[i]->stats });
+                        fold(stats.event_types[type].calls, table.owners[i]->stats);
+                    }
+                }
+            }
+            return stats;
+        }
+        void reset_stats() {
+            std::unique_lock lock(m_registration_mutex, std::defer_lock);
+            if (m_concurrent_registration) {
+                lock.lock();
+            }
+            m_stats = {};
+            m_departed = {};
+            for (EventTypeId type = 0; type < EVENT_TYPE_COUNT; type++) {
+                for (auto owner : table_of(type).owners) {
+                    if (owner != nullptr) {
+                        owner->stats = {};
+                    }
+                }
+            }
+        }
+#endif
+        // when double buffered, process_queue only dispatches the events queued before it started - events pushed
+        // by handlers wait for the next call. Both buffers keep their blocks, so steady state does not allocate.
+        // Must be called while no events are queued.
+        void set_double_buffered(bool doubleBuffered) {
+            assert(is_drained() && "Buffering can only change while the queue is empty");
+            assert(m_capacity == 0 && "A bounded bus cannot be double buffered");
+            m_double_buffered = doubleBuffered;
+        }
+        [[nodiscard]] inline bool is_double_buffered() const {
+            return m_double_buffered;
+        }
+        [[nodiscard]] inline OverflowPolicy get_overflow_policy() const {
+            return m_overflow;
+        }
+        // events single-threaded lanes dropped because they were full
+        [[nodiscard]] inline std::size_t get_dropped_events() const {
+            return m_dropped;
+        }
+        // calls callable(const T&) for every event of type T until the token is reset or destroyed. A callable
+        // returning bool stops propagation by returning true. Without subclassing there is no vtable in the way -
+        // the callable is inlined into a thunk typed on both T and the callable. See HandlerExecution for `execution`.
+        template<typename T, typename Callable>
+        [[nodiscard]] SubscriptionToken subscribe(Callable&& callable, HandlerPriority priority = 0,
+                                                  HandlerExecution execution = HandlerExecution::Sequential) {
+            using Function = std::decay_t<Callable>;
+            static_assert(std::is_invocable_v<Function&, const T&>, "Callable must accept a const reference to the event");
+            Listener* listener;
+            change_registration([&]() {
+                listener = m_listeners.acquire();
+                m_listener_count++;
+                if constexpr (sizeof(Function) <= Listener::BUFFER_SIZE && alignof(Function) <= alignof(std::max_align_t)
+                              && std::is_nothrow_move_constructible_v<Function>) {
+                    listener->callable = new (listener->buffer) Function(std::forward<Callable>(callable));
+                    listener->destroy = [](void* stored) {
+                        static_cast<Function*>(stored)->~Function();
+                    };
+                } else {
+                    listener->callable = new Function(std::forward<Callable>(callable));
+                    listener->destroy = [](void* stored) {
+                        delete static_cast<Function*>(stored);
+                    };
+                }
+                listener->subscription = { event_type_id<T>, execution, nullptr, priority, 0 };
+                HandlerDelegate delegate { listener->callable, [](void* stored, const Event& event) -> bool {
+                    auto& function = *static_cast<Function*>(stored);
+                    if constexpr (std::is_same_v<std::invoke_result_t<Function&, const T&>, bool>) {
+                        return function(static_cast<const T&>(event));
+                    } else {
+                        function(static_cast<const T&>(event));
+                        return false;
+                    }
+                } };
+                add_entry(listener->subscription, delegate);
+            });
+            return { *this, listener };
+        }
+        // lets handlers and callables be (un)registered from any thread, also while another thread is dispatching.
+        // Dispatch then reads published copies of the handler tables and never waits: a registering thread copies
+        // the table it changes under a lock only registering threads take, publishes the copy and leaves the old
+        // one to be freed once the dispatching thread has moved on to another event. Subscribing returns right away.
+        // Unsubscribing from another thread returns once the dispatching thread is done with the event (or, in
+        // process_queue_batched, the batch) it may be calling the handler for - so a handler must not wait on a
+        // thread that unsubscribes from the same bus. Handlers unsubscribed by a handler are skipped for the rest of
+        // the event. One thread dispatches at a time, and handlers created or destroyed off the dispatching thread
+        // should connect late and disconnect early, see HandlerConnection.
+        // Must be called while no other thread uses the bus.
+        void set_concurrent_registration(bool concurrent) {
+            assert(m_dispatch_depth == 0 && "Registration mode can only change outside of dispatch");
+            if (concurrent == m_concurrent_registration) {
+                return;
+            }
+            for (EventTypeId type = 0; type < EVENT_TYPE_COUNT; type++) {
+                auto& table = m_dispatch_tables[type];
+                if (concurrent) {
+                    // published tables have no holes
+                    shrink(table, true);
+                    m_published[type].store(new DispatchTable(std::move(table)), std::memory_order_relaxed);
+                    table = {};
+                } else {
+                    std::unique_ptr<DispatchTable> published(m_published[type].exchange(nullptr, std::memory_order_relaxed));
+                    table = std::move(*published);
+                    for (std::size_t i = 0; i < table.owners.size(); i++) {
+                        table.owners[i]->slot = static_cast<std::uint32_t>(i);
+                    }
+                }
+            }
+            m_retired_tables.clear();
+            m_concurrent_registration = concurrent;
+        }
+        [[nodiscard]] inline bool is_concurrent_registration() const {
+            return m_concurrent_registration;
+        }
+        // dispatches on `threads` threads, the dispatching one included. Parallel handlers next to each other in
+        // priority order run at the same time, spread over the threads - once the handlers before them have
+        // returned without stopping propagation, and before any handler after them. Sequential handlers run on
+        // the dispatching thread as before, and everything has returned by the time dispatch does.
+        // One thread, the default, runs every handler on the dispatching thread. Must be called outside of dispatch.
+        void set_worker_threads(std::size_t threads) {
+            assert(m_dispatch_depth == 0 && "Worker threads can only change outside of dispatch");
+            m_workers = threads > 1 ? std::make_unique<WorkStealingPool>(threads) : nullptr;
+        }
+        [[nodiscard]] inline std::size_t get_worker_threads() const {
+            return m_workers != nullptr ? m_workers->get_thread_count() : 1;
+        }
+        // buses are independent - each has its own queue and handler tables. Handlers hold on to the bus
+        // they are registered with, so it must outlive them.
+        EventBus() = default;
+        ~EventBus() {
+            for (auto& published : m_published) {
+                delete published.load(std::memory_order_relaxed);
+            }
+        }
+        // bounded bus - every priority lane is a preallocated ring of `capacity` events, a nonzero power of two, or a
+        // multi-producer queue of the same size, and `overflow` decides what happens to an event pushed onto a
+        // full lane
+        EventBus(std::size_t capacity, OverflowPolicy overflow, QueueMode mode = QueueMode::SingleThreaded)
+            : m_overflow(overflow), m_capacity(capacity) {
+            // a capacity of 0 would leave the bus unbounded
+            assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "Capacity must be a nonzero power of two");
+            assert((overflow != OverflowPolicy::Block || mode == QueueMode::MultiProducer) && "Only a multi-producer bus can block");
+            set_queue_mode(mode);
+        }
+        // shared bus used by handlers that are not given one explicitly
+        static EventBus& get_instance() {
+            static EventBus instance;
+            return instance;
+        }
+        EventBus(EventBus const&) = delete;
+        void operator=(EventBus const&) = delete;
+        // `delegate` calls the handler - the same one for every event type it is subscribed to. The subscriptions
+        // are all the bus keeps of a handler, so they also identify it when it unregisters.
+        void register_handler(HandlerDelegate delegate, std::span<Subscription> subscriptions) override {
+            change_registration([&]() {
+                m_handler_count++;
+                // add handler to the dispatch table of every event type it is subscribed to
+                for (auto& subscription : subscriptions) {
+                    add_entry(subscription, delegate);
+                }
+            });
+        }
+        void unregister_handler(std::span<Subscription> subscriptions) override {
+            change_registration([&]() {
+                assert(m_handler_count > 0 && "Something went wrong - no handler is registered");
+                m_handler_count--;
+                for (auto& subscription : subscriptions) {
+                    remove_entry(subscription);
+                }
+            });
+            if (m_concurrent_registration) {
+                release_concurrently(subscriptions, []() { });
+            }
+        }
+    private:
+        friend struct SubscriptionToken;
+        void unsubscribe(Listener* listener) {
+            change_registration([&]() {
+                remove_entry(listener->subscription);
+                m_listener_count--;
+            });
+            if (m_concurrent_registration) {
+                release_concurrently(std::span<Subscription>(&listener->subscription, 1), [&]() {
+                    retire_listener(listener);
+                });
+            } else {
+                retire_listener(listener);
+            }
+        }
+        void retire_listener(Listener* listener) {
+            if (is_dispatching_here()) {
+                // the callable may be the one running right now
+                m_retired.push_back(listener);
+            } else {
+                retire(listener);
+            }
+        }
+        void retire(Listener* listener) {
+            listener->destroy(listener->callable);
+            m_listeners.release(listener);
+        }
+        [[nodiscard]] inline bool has_subscribers() const {
+            // with concurrent registration the counts change under a lock dispatch does not take
+            return m_concurrent_registration || m_handler_count > 0 || m_listener_count > 0;
+        }
+        // runs `change` on the handler tables - with concurrent registration under the lock registering threads share
+        template<typename Change>
+        void change_registration(Change&& change) {
+            if (!m_concurrent_registration) {
+                change();
+                return;
+            }
+            std::lock_guard lock(m_registration_mutex);
+            change();
+        }
+        // whether the calling thread is inside dispatch - with concurrent registration only the dispatching thread is
+        [[nodiscard]] inline bool is_dispatching_here() const {
+            if (m_concurrent_registration) {
+                return m_dispatcher.load(std::memory_order_relaxed) == std::this_thread::get_id();
+            }
+            return m_dispatch_depth > 0;
+        }
+        // the table dispatch reads for `type` - with concurrent registration the published copy
+        [[nodiscard]] inline DispatchTable& table_of(EventTypeId type) const {
+            if (m_concurrent_registration) {
+                // ordered against the epoch, see publish
+                return *m_published[type].load(std::memory_order_seq_cst);
+            }
+            return const_cast<DispatchTable&>(m_dispatch_tables[type]);
+        }
+        // false for holes and for entries unsubscribed by a handler during the event being dispatched
+        [[nodiscard]] inline bool is_connected(const DispatchTable& table, std::size_t index) const {
+            auto owner = table.owners[index];
+            return owner != nullptr && (m_removed.empty() || std::find(m_removed.begin(), m_removed.end(), owner) == m_removed.end());
+        }
+        void add_entry(Subscription& subscription, HandlerDelegate handler) {
+            if (!m_concurrent_registration) {
+                insert(m_dispatch_tables[subscription.type], subscription, handler);
+                return;
+            }
+            publish(subscription.type, [&](DispatchTable& table) {
+                auto position = std::upper_bound(table.priorities.begin(), table.priorities.end(), subscription.priority, std::greater<>())
+                              - table.priorities.begin();
+                table.entries.insert(table.entries.begin() + position, handler);
+                table.owners.insert(table.owners.begin() + position, &subscription);
+                table.priorities.insert(table.priorities.begin() + position, subscription.priority);
+            });
+        }
+        void remove_entry(Subscription& subscription) {
+            if (!m_concurrent_registration) {
+                remove(subscription);
+                return;
+            }
+            publish(subscription.type, [&](DispatchTable& table) {
+                auto position = std::find(table.owners.begin(), table.owners.end(), &subscription) - table.owners.begin();
+                table.entries.erase(table.entries.begin() + position);
+                table.owners.erase(table.owners.begin() + position);
+                table.priorities.erase(table.priorities.begin() + position);
+            });
+        }
+        // publishes an edited copy of the table of `type`. The table it replaces is freed once the dispatching thread
+        // has passed a quiescent point - the epoch it was retired in is over. Called under the registration lock.
+        template<typename Edit>
+        void publish(EventTypeId type, Edit&& edit) {
+            auto epoch = m_epoch.load(std::memory_order_seq_cst);
+            std::erase_if(m_retired_tables, [epoch](const RetiredTable& retired) {
+                return retired.epoch % 2 == 0 || retired.epoch != epoch;
+            });
+            auto current = m_published[type].load(std::memory_order_relaxed);
+            auto copy = std::make_unique<DispatchTable>(*current);
+            edit(*copy);
+            m_published[type].store(copy.release(), std::memory_order_seq_cst);
+            // read after publishing - a dispatch starting later reads the copy
+            m_retired_tables.push_back({ std::unique_ptr<DispatchTable>(current), m_epoch.load(std::memory_order_seq_cst) });
+        }
+        // once the dispatching thread cannot call the removed `subscriptions` any more, folds their calls into the
+        // departed totals and runs `release`. A handler unsubscribing itself or another one does not wait for the
+        // event it is part of - the entries it removed are skipped for the rest of it.
+        template<typename Release>
+        void release_concurrently(std::span<Subscription> subscriptions, Release&& release) {
+            if (is_dispatching_here()) {
+                for (auto& subscription : subscriptions) {
+                    m_removed.push_back(&subscription);
+                }
+            } else {
+                wait_for_dispatch();
+            }
+            std::lock_guard lock(m_registration_mutex);
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+            for (auto& subscription : subscriptions) {
+                fold(m_departed[subscription.type], subscription.stats);
+            }
+#endif
+            release();
+        }
+        // waits until the dispatching thread has moved past the event it was dispatching, if any - it reads the
+        // tables published since
+        void wait_for_dispatch() {
+            auto epoch = m_epoch.load(std::memory_order_seq_cst);
+            if (epoch % 2 == 1) {
+                while (m_epoch.load(std::memory_order_acquire) == epoch) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        void begin_dispatch() {
+            if (m_dispatch_depth == 0 && m_concurrent_registration) {
+                // odd while dispatching - the tables read from here on are in use
+                m_dispatcher.store(std::this_thread::get_id(), std::memory_order_relaxed);
+                m_epoch.store(m_epoch.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+            }
+            m_dispatch_depth++;
+        }
+        // no handler is running between two top level events - the tables read for the last one are no longer in use
+        inline void pass_quiescent_point() {
+            if (m_concurrent_registration && m_dispatch_depth == 1) {
+                m_epoch.store(m_epoch.load(std::memory_order_relaxed) + 2, std::memory_order_seq_cst);
+                m_removed.clear();
+            }
+        }
+        // punch a hole in the subscription's dispatch table, keeping the order of the rest
+        void remove(Subscription& subscription) {
+            if (subscription.slot == PENDING_SLOT) {
+                // registered during dispatch and never inserted
+                auto pending = std::find_if(m_pending.begin(), m_pending.end(), [&](auto& entry) {
+                    return entry.subscription == &subscription;
+                });
+                m_pending.erase(pending);
+                return;
+            }
+            auto& table = m_dispatch_tables[subscription.type];
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+            // keep the calls of departed handlers in the per type totals
+            fold(m_stats.event_types[subscription.type].calls, subscription.stats);
+#endif
+            table.entries[subscription.slot] = HandlerDelegate::hole();
+            table.owners[subscription.slot] = nullptr;
+            table.holes++;
+            if (m_dispatch_depth == 0) {
+                shrink(table);
+            }
+        }
+        // one queue per event priority
+        struct Lane {
+            // producers push to `queue`. When double buffered, process_queue drains `front` instead
+            EventStream queue {};
+            EventStream front {};
+            // replaces both streams in multi-producer mode
+            std::unique_ptr<ConcurrentEventQueue> concurrent {};
+            // a bounded bus queues here first. `queue` only takes the events a full ring grows into, and takes all
+            // of them until it has drained, so the ring always holds the older events
+            std::unique_ptr<EventRing> ring {};
+            // per coalesced event type, the queued event that later pushes merge into - until dispatch reaches it
+            std::array<Event*, EVENT_TYPE_COUNT> waiting {};
+        };
+        // queues an event on a single-threaded lane, applying the overflow policy. `place(queue)` constructs the event
+        // in an EventStream or EventRing and returns it - the ring returns nullptr when full. Returns the queued
+        // event, or nullptr if it was dropped.
+        template<typename Place>
+        Event* enqueue(Lane& lane, Place&& place) {
+            auto event = lane.ring != nullptr && lane.queue.empty() ? place(*lane.ring) : nullptr;
+            if (event == nullptr) {
+                if (lane.ring == nullptr || m_overflow == OverflowPolicy::Grow) {
+                    event = place(lane.queue);
+                } else if (m_overflow == OverflowPolicy::DropOldest && m_dispatch_depth == 0) {
+                    auto& oldest = lane.ring->front();
+                    if (lane.waiting[oldest.get_type()] == &oldest) {
+                        lane.waiting[oldest.get_type()] = nullptr;
+                    }
+                    lane.ring->pop();
+                    m_dropped++;
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+                    m_queued--;
+#endif
+                    event = place(*lane.ring);
+                } else {
+                    assert(m_overflow != OverflowPolicy::Block && "A single-threaded queue cannot block - nothing would make room");
+                }
+            }
+            if (event == nullptr) {
+                m_dropped++;
+                return nullptr;
+            }
+            m_push_count++;
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+            record_queue_depth(++m_queued);
+#endif
+            return event;
+        }
+        // pushes to the multi-producer queue with `push`, retrying while it is full if the overflow policy blocks
+        template<typename Push>
+        bool try_concurrent(Push&& push) {
+            if (m_overflow != OverflowPolicy::Block) {
+                return push();
+            }
+            while (!push()) {
+                std::this_thread::yield();
+            }
+            return true;
+        }
+        // hands queued events to `consume` and pops them, until the queue is empty, `limit` events were consumed or
+        // `deadline` has passed. Returns the number of events consumed. Lanes are drained in priority order and
+        // each lane in FIFO order.
+        template<typename Consume>
+        std::size_t drain(Consume&& consume, std::size_t limit = std::numeric_limits<std::size_t>::max(),
+                          std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+            auto has_deadline = deadline != std::chrono::steady_clock::time_point::max();
+            auto out_of_budget = [&](std::size_t consumed) {
+                if (consumed == limit) {
+                    return true;
+                }
+                return has_deadline && consumed % DEADLINE_CHECK_INTERVAL == 0 && std::chrono::steady_clock::now() >= deadline;
+            };
+            // events this drain may still take from each lane
+            std::array<std::size_t, EVENT_PRIORITY_COUNT> available;
+            available.fill(std::numeric_limits<std::size_t>::max());
+            if (m_double_buffered) {
+                for (std::size_t i = 0; i < EVENT_PRIORITY_COUNT; i++) {
+                    auto& lane = m_lanes[i];
+                    if (m_mode == QueueMode::MultiProducer) {
+                        // stop at the events claimed before the drain started
+                        available[i] = lane.concurrent->pending();
+                    } else if (lane.front.empty()) {
+                        // take the back buffer so pushes made by handlers go to a fresh one. A call after one that ran
+                        // out of budget keeps draining the buffer that was taken before.
+                        lane.front.swap(lane.queue);
+                        // events of this frame stop absorbing pushes, which belong to the next one
+                        lane.waiting.fill(nullptr);
+                    }
+                }
+            }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+            if (m_mode == QueueMode::MultiProducer) {
+                std::size_t depth = 0;
+                for (auto& lane : m_lanes) {
+                    depth += lane.concurrent->pending();
+                }
+                record_queue_depth(depth);
+            }
+#endif
+            std::size_t consumed = 0;
+            while (!out_of_budget(consumed)) {
+                auto turn = select_lane(available);
+                if (turn.lane == EVENT_PRIORITY_COUNT) {
+                    break;
+                }
+                // keep taking from the selected lane for the rest of its turn, as long as nothing was pushed that
+                // could change the selection. Producers on other threads can push at any time, so in
+                // multi-producer mode the lane is selected again for every event.
+                auto& lane = m_lanes[turn.lane];
+                std::size_t taken = 0;
+                if (m_mode == QueueMode::MultiProducer) {
+                    consume(*lane.concurrent->front());
+                    lane.concurrent->pop();
+                    available[turn.lane]--;
+                    taken++;
+                } else {
+                    auto pushes = m_push_count;
+                    auto take = [&](auto& queue) {
+                        do {
+                            auto& event = queue.front();
+                            if (lane.waiting[event.get_type()] == &event) {
+                                lane.waiting[event.get_type()] = nullptr;
+                            }
+                            consume(event);
+                            queue.pop();
+                            taken++;
+                        } while (taken < turn.events && pushes == m_push_count && !queue.empty() && !out_of_budget(consumed + taken));
+                    };
+                    // a bounded lane's ring holds its older events
+                    if (lane.ring != nullptr && !lane.ring->empty()) {
+                        take(*lane.ring);
+                    } else {
+                        take(m_double_buffered ? lane.front : lane.queue);
+                    }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+                    m_queued -= taken;
+#endif
+                }
+                consumed += taken;
+                if (turn.starving) {
+                    m_starved_for += taken;
+                }
+            }
+            return consumed;
+        }
+        struct LaneTurn {
+            std::size_t lane;
+            // number of events the lane may take before the selection has to be made again
+            std::size_t events;
+            // lower lanes are waiting while this one is served
+            bool starving;
+        };
+        // the highest priority lane with an event available - except that once lower lanes have waited for
+        // STARVATION_LIMIT events in a row, one event is taken from them, rotating between the lower lanes
+        LaneTurn select_lane(const std::array<std::size_t, EVENT_PRIORITY_COUNT>& available) {
+            auto ready = [&](std::size_t index) {
+                return available[index] > 0 && peek(m_lanes[index]) != nullptr;
+            };
+            std::size_t top = 0;
+            while (top < EVENT_PRIORITY_COUNT && !ready(top)) {
+                top++;
+            }
+            if (top == EVENT_PRIORITY_COUNT) {
+                return { top, 0, false };
+            }
+            auto lower_waiting = false;
+            for (auto index = top + 1; index < EVENT_PRIORITY_COUNT; index++) {
+                lower_waiting = lower_waiting || ready(index);
+            }
+            if (!lower_waiting) {
+                m_starved_for = 0;
+                return { top, std::numeric_limits<std::size_t>::max(), false };
+            }
+            if (m_starved_for < STARVATION_LIMIT) {
+                return { top, STARVATION_LIMIT - m_starved_for, true };
+            }
+            m_starved_for = 0;
+            for (std::size_t step = 1; step <= EVENT_PRIORITY_COUNT; step++) {
+                auto index = (m_aging_cursor + step) % EVENT_PRIORITY_COUNT;
+                if (index > top && ready(index)) {
+                    m_aging_cursor = index;
+                    return { index, 1, false };
+                }
+            }
+            return { top, 1, false };
+        }
+        [[nodiscard]] inline Event* peek(Lane& lane) {
+            if (m_mode == QueueMode::MultiProducer) {
+                return lane.concurrent->front();
+            }
+            if (lane.ring != nullptr && !lane.ring->empty()) {
+                return &lane.ring->front();
+            }
+            auto& queue = m_double_buffered ? lane.front : lane.queue;
+            return queue.empty() ? nullptr : &queue.front();
+        }
+        [[nodiscard]] inline bool is_drained() {
+            for (auto& lane : m_lanes) {
+                auto ring_empty = lane.ring == nullptr || lane.ring->empty();
+                if (m_mode == QueueMode::MultiProducer ? lane.concurrent->front() != nullptr : !lane.queue.empty() || !lane.front.empty() || !ring_empty) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        // returns true if a handler stopped propagation
+        bool dispatch(const Event& event) {
+            // only handlers subscribed to this event type are visited
+            auto& table = table_of(event.get_type());
+            auto& entries = table.entries;
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+            m_stats.event_types[event.get_type()].dispatched++;
+#endif
+            if (m_workers != nullptr) {
+                return dispatch_parallel(table, event);
+            }
+            // handlers subscribed during dispatch only see the next event
+            auto count = entries.size();
+            for (std::size_t i = 0; i < count; i++) {
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+                if (!is_connected(table, i)) {
+                    continue;
+                }
+                auto start = std::chrono::steady_clock::now();
+                auto stop_propagation = entries[i](event);
+                record_call(table, i, event, start, stop_propagation);
+#else
+                // holes are calls that do nothing - only handlers unsubscribed during this event need a check
+                if (!m_removed.empty() && !is_connected(table, i)) {
+                    continue;
+                }
+                auto stop_propagation = entries[i](event);
+#endif
+                if (stop_propagation) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        // runs of parallel handlers go to the pool as a whole, everything else is called here in table order
+        bool dispatch_parallel(DispatchTable& table, const Event& event) {
+            auto count = table.entries.size();
+            for (std::size_t i = 0; i < count;) {
+                auto end = i;
+                while (end < count && is_connected(table, end) && table.owners[end]->execution == HandlerExecution::Parallel) {
+                    end++;
+                }
+                if (end > i) {
+                    // parallel handlers never stop propagation
+                    m_workers->parallel_for(end - i, [this, &table, &event, first = i](std::size_t index) {
+                        call(table, first + index, event);
+                    });
+                    i = end;
+                } else if (call(table, i++, event)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        // calls one table entry and returns true if it stopped propagation
+        bool call(DispatchTable& table, std::size_t index, const Event& event) {
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+            if (!is_connected(table, index)) {
+                return false;
+            }
+            auto start = std::chrono::steady_clock::now();
+            auto stop_propagation = table.entries[index](event);
+            record_call(table, index, event, start, stop_propagation);
+            return stop_propagation;
+#else
+            if (!m_removed.empty() && !is_connected(table, index)) {
+                return false;
+            }
+            return table.entries[index](event);
+#endif
+        }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+        // a handler that disconnected itself during the call has no subscription left to record into - the call
+        // goes to the per type totals, where remove already folded its earlier calls
+        void record_call(DispatchTable& table, std::size_t index, const Event& event, std::chrono::steady_clock::time_point start,
+                         bool stopPropagation) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            (is_connected(table, index) ? table.owners[index]->stats : m_stats.event_types[event.get_type()].calls).record(elapsed, stopPropagation);
+        }
+#endif
+        // places the subscription after every entry of higher or equal priority. Appending is constant time; inserting
+        // in the middle shifts the tail of the table and is deferred until dispatch is over.
+        void insert(DispatchTable& table, Subscription& subscription, HandlerDelegate handler) {
+            auto position = static_cast<std::size_t>(std::upper_bound(table.priorities.begin(), table.priorities.end(),
+                                                                      subscription.priority, std::greater<>()) - table.priorities.begin());
+            if (position < table.entries.size() && m_dispatch_depth > 0) {
+                subscription.slot = PENDING_SLOT;
+                m_pending.push_back({ &subscription, handler });
+                return;
+            }
+            auto offset = static_cast<std::ptrdiff_t>(position);
+            table.entries.insert(table.entries.begin() + offset, handler);
+            table.owners.insert(table.owners.begin() + offset, &subscription);
+            table.priorities.insert(table.priorities.begin() + offset, subscription.priority);
+            for (auto i = position; i < table.owners.size(); i++) {
+                if (table.owners[i] != nullptr) {
+                    table.owners[i]->slot = static_cast<std::uint32_t>(i);
+                }
+            }
+        }
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+        static void fold(HandlerCallStats& total, const HandlerCallStats& calls) {
+            total.invocations += calls.invocations;
+            total.stopped_propagation += calls.stopped_propagation;
+            total.time.merge(calls.time);
+        }
+        void record_queue_depth(std::size_t depth) {
+            m_stats.queue_depth.peak = std::max(m_stats.queue_depth.peak, depth);
+            m_stats.queue_depth.samples++;
+            m_stats.queue_depth.total += depth;
+        }
+#endif
+        void finish_dispatch() {
+            m_dispatch_depth--;
+            if (m_dispatch_depth == 0 && m_concurrent_registration) {
+                m_removed.clear();
+                m_epoch.store(m_epoch.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+                m_dispatcher.store(std::thread::id(), std::memory_order_relaxed);
+                // callables unsubscribed during dispatch go back to the pool registering threads share
+                if (!m_retired.empty()) {
+                    std::lock_guard lock(m_registration_mutex);
+                    for (auto listener : m_retired) {
+                        retire(listener);
+                    }
+                    m_retired.clear();
+                }
+            } else if (m_dispatch_depth == 0) {
+                // tables could not move while handlers were running - insert what was registered meanwhile and
+                // tidy up what was unsubscribed, callables included
+                for (auto& pending : m_pending) {
+                    insert(m_dispatch_tables[pending.subscription->type], *pending.subscription, pending.handler);
+                }
+                m_pending.clear();
+                for (auto listener : m_retired) {
+                    retire(listener);
+                }
+                m_retired.clear();
+                for (auto& table : m_dispatch_tables) {
+                    if (table.holes > 0) {
+                        shrink(table);
+                    }
+                }
+            }
+        }
+        // drop holes at the end of the table, and compact it once holes are at least half of it - or right away
+        static void shrink(DispatchTable& table, bool compact = false) {
+            while (!table.entries.empty() && table.entries.back().is_hole()) {
+                table.entries.pop_back();
+                table.owners.pop_back();
+                table.priorities.pop_back();
+                table.holes--;
+            }
+            if (!compact && table.holes * 2 < table.entries.size()) {
+                return;
+            }
+            std::size_t write = 0;
+            for (std::size_t read = 0; read < table.entries.size(); read++) {
+                if (!table.entries[read].is_hole()) {
+                    table.entries[write] = table.entries[read];
+                    table.owners[write] = table.owners[read];
+                    table.priorities[write] = table.priorities[read];
+                    table.owners[write]->slot = static_cast<std::uint32_t>(write);
+                    write++;
+                }
+            }
+            table.entries.resize(write);
+            table.owners.resize(write);
+            table.priorities.resize(write);
+            table.holes = 0;
+        }
+    private:
+        static constexpr std::size_t DEFAULT_CONCURRENT_CAPACITY = 1 << 14;
+        static constexpr std::size_t DEADLINE_CHECK_INTERVAL = 16;
+        static constexpr std::size_t STARVATION_LIMIT = 32;
+        static constexpr std::uint32_t PENDING_SLOT = std::numeric_limits<std::uint32_t>::max();
+        struct PendingSubscription {
+            Subscription* subscription;
+            HandlerDelegate handler;
+        };
+        // dispatch only goes through the tables - the bus just counts the handlers registered with it
+        std::size_t m_handler_count { 0 };
+        // every listener record is owned by the pool and freed with the bus
+        NodePool<Listener> m_listeners {};
+        std::size_t m_listener_count { 0 };
+        // number of process_queue calls currently running - dispatch tables are only compacted at zero
+        std::uint32_t m_dispatch_depth { 0 };
+        // a process_queue call is running - the event it dispatches stays at the front of its lane until the handlers
+        // have returned, and batches hand out spans of their storage, so nested calls must not touch the queue
+        bool m_draining { false };
+        // with concurrent registration the counts, the listener pool and the published tables are changed under
+        // m_registration_mutex, and dispatch reads m_published instead of m_dispatch_tables
+        bool m_concurrent_registration { false };
+        mutable std::mutex m_registration_mutex {};
+        std::array<std::atomic<DispatchTable*>, EVENT_TYPE_COUNT> m_published {};
+        // tables replaced while `epoch` was current
+        struct RetiredTable {
+            std::unique_ptr<DispatchTable> table;
+            std::uint64_t epoch;
+        };
+        std::vector<RetiredTable> m_retired_tables {};
+        // odd while a thread dispatches, and moved on by 2 at every quiescent point between two events
+        std::atomic<std::uint64_t> m_epoch { 0 };
+        std::atomic<std::thread::id> m_dispatcher {};
+        // subscriptions handlers removed during the current event - still in the tables it reads
+        std::vector<const Subscription*> m_removed {};
+        QueueMode m_mode { QueueMode::SingleThreaded };
+        // Grow keeps the unbounded default bus growing - only bounded buses and the multi-producer queue overflow
+        OverflowPolicy m_overflow { OverflowPolicy::Grow };
+        // lane size of a bounded bus, 0 when unbounded
+        std::size_t m_capacity { 0 };
+        std::size_t m_dropped { 0 };
+        bool m_double_buffered { false };
+        std::array<Lane, EVENT_PRIORITY_COUNT> m_lanes {};
+        // events taken from higher lanes while a lower lane was waiting, and the lower lane served last
+        std::size_t m_starved_for { 0 };
+        std::size_t m_aging_cursor { 0 };
+        // single-threaded pushes so far - lets the drain skip lane selection while nothing new was queued
+        std::size_t m_push_count { 0 };
+        // contiguous array of subscribed handlers per event type, by descending priority and in registration order within one
+        std::array<DispatchTable, EVENT_TYPE_COUNT> m_dispatch_tables {};
+        // parallel handlers run here when set, see set_worker_threads
+        std::unique_ptr<WorkStealingPool> m_workers {};
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+        // per event type dispatch counts and queue depth - per handler numbers live in the subscriptions
+        DispatchStats m_stats {};
+        // calls of handlers unsubscribed with concurrent registration, under m_registration_mutex
+        std::array<HandlerCallStats, EVENT_TYPE_COUNT> m_departed {};
+        // events waiting in single-threaded lanes
+        std::size_t m_queued { 0 };
+#endif
+        // merge function of every coalesced event type, empty for the others
+        std::array<std::function<void(Event&, Event&&)>, EVENT_TYPE_COUNT> m_coalescing {};
+        // subscriptions registered during dispatch that could not be appended
+        std::vector<PendingSubscription> m_pending {};
+        // callables unsubscribed during dispatch, destroyed once it is over
+        std::vector<Listener*> m_retired {};
+        EventBatches<EventRegistry> m_batches {};
+};
+void SubscriptionToken::reset() {
+    if (m_listener != nullptr) {
+        m_bus->unsubscribe(m_listener);
+        m_bus = nullptr;
+        m_listener = nullptr;
+    }
+}
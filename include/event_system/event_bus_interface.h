@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "event.h"
+#include "instrumentation.h"
+#include "node_pool.h"
+
+// base of every EventHandler, for code owning handlers of different types - dispatch goes through HandlerDelegate
+struct IEventHandler {
+    virtual ~IEventHandler() = default;
+};
+
+
+// handler call stored in the dispatch tables - the handler object and a thunk that knows its type, so dispatch
+// makes a single indirect call and never touches the handlers it does not call
+struct HandlerDelegate {
+    void* object;
+    bool (*invoke)(void* object, const Event& event);
+
+    // placeholder of an unsubscribed entry - calling it does nothing, so dispatch needs no separate check
+    static constexpr HandlerDelegate hole() {
+        return { nullptr, [](void*, const Event&) -> bool {
+            return false;
+        } };
+    }
+    [[nodiscard]] inline bool is_hole() const {
+        return object == nullptr;
+    }
+    inline bool operator()(const Event& event) const {
+        return invoke(object, event);
+    }
+};
+
+
+using HandlerPriority = std::int32_t;
+// where the bus may run a handler once it has worker threads, see EventBus::set_worker_threads
+enum class HandlerExecution : std::uint8_t {
+    // on the dispatching thread, in priority order
+    Sequential,
+    // on any of the bus's threads, at the same time as the parallel handlers next to it in priority order. The
+    // handler must not stop propagation and must not use the bus, except for pushing events in multi-producer
+    // mode.
+    Parallel
+};
+// a handler's entry in the dispatch table of one event type. It is owned by the handler and the bus keeps
+// `slot` pointing at the entry's current position, so unsubscribing never has to search the table.
+struct Subscription {
+    EventTypeId type;
+    HandlerExecution execution;
+    // IBatchHandler<T>* for the subscribed event type T
+    void* batch_handler;
+    HandlerPriority priority;
+    std::uint32_t slot;
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+    HandlerCallStats stats {};
+#endif
+};
+
+
+struct IEventBus {
+    public:
+        // push_to_queue is a template on EventBus so the concrete event type reaches the queue
+        virtual void process_queue() = 0;
+        virtual bool dispatch_now(const Event& event) = 0;
+    private:
+        virtual void register_handler(HandlerDelegate delegate, std::span<Subscription> subscriptions) = 0;
+        virtual void unregister_handler(std::span<Subscription> subscriptions) = 0;
+};
+// optional batch entry point - receives every queued event of type T in one call from process_queue_batched
+template<typename T>
+struct IBatchHandler {
+    virtual ~IBatchHandler() = default;
+    virtual void handle_batch(std::span<const T> events) = 0;
+};
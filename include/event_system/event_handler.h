@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <span>
+
+#include "event.h"
+#include "event_bus.h"
+#include "event_bus_interface.h"
+
+// default batch entry point of a handler - forwards each event of the batch to handle()
+template<typename Handler, typename T>
+struct BatchHandler : public IBatchHandler<T> {
+    void handle_batch(std::span<const T> events) override {
+        auto& handler = static_cast<Handler&>(*this);
+        for (const auto& event : events) {
+            handler.handle(event);
+        }
+    }
+};
+// handlers derive from EventHandler<Derived, Subscribed...>, listing themselves and the event types they subscribe
+// to - the signature is computed at compile time. The bus calls the public Derived::handle(const Event&) through a
+// thunk bound to Derived, so dispatch makes a single indirect call and no virtual one.
+// Handlers with a higher priority run first, handlers with equal priority in registration order.
+// Override handle_batch(std::span<const T>) to receive all events of type T at once from process_queue_batched.
+// A handler connects to its bus in the constructor and disconnects in the destructor. With concurrent registration
+// another thread may dispatch to it while the derived part is not constructed yet or already destroyed - such
+// handlers are built with HandlerConnection::Deferred, call connect() at the end of their constructor and
+// disconnect() at the start of their destructor.
+enum class HandlerConnection {
+    Immediate,
+    Deferred
+};
+template<typename Derived, typename... Subscribed>
+struct EventHandler : public IEventHandler, public BatchHandler<Derived, Subscribed>... {
+    static constexpr EventSignature signature = EventSignature::of<Subscribed...>();
+    static_assert(signature.count() == sizeof...(Subscribed), "An event type can only be subscribed to once");
+
+    EventHandler() : EventHandler(EventBus::get_instance()) { }
+    explicit EventHandler(HandlerPriority priority) : EventHandler(EventBus::get_instance(), priority) { }
+    explicit EventHandler(EventBus& bus, HandlerPriority priority = 0, HandlerConnection connection = HandlerConnection::Immediate)
+        : m_bus(bus) {
+        for (auto& subscription : m_subscriptions) {
+            subscription.priority = priority;
+        }
+        if (connection == HandlerConnection::Immediate) {
+            connect();
+        }
+    }
+    // the bus points into the handler's subscriptions - a copy would share them
+    EventHandler(EventHandler const&) = delete;
+    void operator=(EventHandler const&) = delete;
+    ~EventHandler() override {
+        disconnect();
+    }
+    void connect() {
+        if (!m_connected) {
+            m_bus.register_handler(HandlerDelegate { static_cast<EventHandler*>(this), &invoke }, m_subscriptions);
+            m_connected = true;
+        }
+    }
+    // the bus does not call the handler any more once this returns
+    void disconnect() {
+        if (m_connected) {
+            m_bus.unregister_handler(m_subscriptions);
+            m_connected = false;
+        }
+    }
+    // handlers run sequentially unless they opt in, see HandlerExecution. Must be set while no other thread can
+    // dispatch to the handler - with concurrent registration, before connect().
+    void set_execution(HandlerExecution execution) {
+        for (auto& subscription : m_subscriptions) {
+            subscription.execution = execution;
+        }
+    }
+    [[nodiscard]] inline bool is_connected() const {
+        return m_connected;
+    }
+    [[nodiscard]] inline EventBus& get_bus() const {
+        return m_bus;
+    }
+    private:
+        // the delegate only casts once it is called - by then the derived part exists
+        static bool invoke(void* handler, const Event& event) {
+            return static_cast<Derived*>(static_cast<EventHandler*>(handler))->handle(event);
+        }
+    private:
+        EventBus& m_bus;
+        bool m_connected { false };
+        std::array<Subscription, sizeof...(Subscribed)> m_subscriptions {
+            Subscription { event_type_id<Subscribed>, HandlerExecution::Sequential, static_cast<IBatchHandler<Subscribed>*>(this), 0, 0 }...
+        };
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "event.h"
+
+// Fixed set of pre-constructed events of type T, for events too large to copy into the queue. A producer acquires
+// one, fills it in and hands it to EventBus::submit - the queue only holds a pointer, and once dispatched the event
+// goes back to the pool as it is. No copy, no constructor or destructor call and no allocation per event. Events
+// keep whatever their last user left in them, so producers overwrite every field they use.
+// acquire and release are called by one thread at a time. Queues recycle events from the dispatching thread,
+// which may be another one. The pool must outlive every event it handed out, queued ones included.
+template<typename T>
+struct EventPool {
+    static_assert(std::is_base_of_v<Event, T>, "Only events can be pooled");
+    public:
+        // every event starts out as a copy of `prototype`
+        EventPool(std::size_t capacity, const T& prototype) : m_slots(std::make_unique<Slot[]>(capacity)), m_capacity(capacity) {
+            for (std::size_t i = 0; i < capacity; i++) {
+                auto& slot = m_slots[i];
+                slot.pool = this;
+                new (slot.storage) T(prototype);
+                slot.next = m_free;
+                m_free = &slot;
+            }
+        }
+        EventPool(EventPool const&) = delete;
+        void operator=(EventPool const&) = delete;
+        ~EventPool() {
+            for (std::size_t i = 0; i < m_capacity; i++) {
+                event_of(&m_slots[i])->~T();
+            }
+        }
+        // an event that is not in use, or nullptr if all of them are
+        [[nodiscard]] T* acquire() {
+            if (m_free == nullptr) {
+                // take back everything recycled since the last time in one go
+                m_free = m_recycled.exchange(nullptr, std::memory_order_acquire);
+                if (m_free == nullptr) {
+                    return nullptr;
+                }
+            }
+            auto slot = m_free;
+            m_free = slot->next;
+            return event_of(slot);
+        }
+        // hands back an acquired event that was not submitted
+        void release(T* event) {
+            auto slot = slot_of(event);
+            slot->next = m_free;
+            m_free = slot;
+        }
+        // returns a submitted event to its pool once the queue is done with it - safe to call from any thread
+        static void recycle(Event* event) {
+            auto slot = slot_of(static_cast<T*>(event));
+            auto& recycled = slot->pool->m_recycled;
+            slot->next = recycled.load(std::memory_order_relaxed);
+            while (!recycled.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) { }
+        }
+        [[nodiscard]] inline std::size_t get_capacity() const {
+            return m_capacity;
+        }
+    private:
+        struct Slot {
+            EventPool* pool;
+            Slot* next;
+            alignas(T) std::byte storage[sizeof(T)];
+        };
+        static T* event_of(Slot* slot) {
+            return std::launder(reinterpret_cast<T*>(slot->storage));
+        }
+        static Slot* slot_of(T* event) {
+            return reinterpret_cast<Slot*>(reinterpret_cast<std::byte*>(event) - offsetof(Slot, storage));
+        }
+    private:
+        std::unique_ptr<Slot[]> m_slots;
+        std::size_t m_capacity;
+        // free events only the acquiring thread touches
+        Slot* m_free { nullptr };
+        // events recycled by the queues since the last time the free list ran dry - pushed one by one, taken all
+        // at once, so there is no ABA problem
+        std::atomic<Slot*> m_recycled { nullptr };
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "event_slot.h"
+
+// Bounded FIFO of heterogeneous events in a preallocated power-of-two ring of fixed-size slots. Events are
+// constructed in their slot and slots are reused in order, so the ring never allocates after construction and
+// the consumer walks memory linearly. Events larger than a slot go through an EventPool and push.
+struct EventRing {
+    public:
+        explicit EventRing(std::size_t capacity) : m_mask(capacity - 1), m_slots(std::make_unique<EventSlot[]>(capacity)) {
+            assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "Capacity must be a power of two");
+        }
+        EventRing(EventRing const&) = delete;
+        void operator=(EventRing const&) = delete;
+        ~EventRing() {
+            clear();
+        }
+        // returns nullptr if the ring is full
+        template<typename T, typename... Args>
+        T* try_emplace(Args&&... args) {
+            if (full()) {
+                return nullptr;
+            }
+            auto event = m_slots[m_tail & m_mask].template emplace<T>(std::forward<Args>(args)...);
+            m_tail++;
+            return event;
+        }
+        // queues an event stored elsewhere, see EventSlot::hold. Returns nullptr if the ring is full.
+        Event* try_push(Event& event, EventRelease release) {
+            if (full()) {
+                return nullptr;
+            }
+            m_slots[m_tail & m_mask].hold(event, release);
+            m_tail++;
+            return &event;
+        }
+        [[nodiscard]] inline Event& front() {
+            assert(!empty() && "Cannot read from an empty ring");
+            return m_slots[m_head & m_mask].get_event();
+        }
+        void pop() {
+            assert(!empty() && "Cannot pop from an empty ring");
+            m_slots[m_head & m_mask].release();
+            m_head++;
+        }
+        [[nodiscard]] inline bool empty() const {
+            return m_head == m_tail;
+        }
+        [[nodiscard]] inline bool full() const {
+            return m_tail - m_head > m_mask;
+        }
+        [[nodiscard]] inline std::size_t get_capacity() const {
+            return m_mask + 1;
+        }
+        void clear() {
+            while (!empty()) {
+                pop();
+            }
+        }
+    private:
+        const std::size_t m_mask;
+        std::unique_ptr<EventSlot[]> m_slots;
+        // both only ever grow - their difference is the number of queued events
+        std::size_t m_head { 0 };
+        std::size_t m_tail { 0 };
+};
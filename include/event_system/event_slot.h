@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "event.h"
+
+// called on a queued event once it is popped - its destructor for events constructed in the queue, or
+// EventPool<T>::recycle for events queued by pointer
+using EventRelease = void (*)(Event* event);
+
+template<typename T>
+constexpr EventRelease destroy_in_place() {
+    static_assert(std::is_base_of_v<Event, T>, "Only events can be queued");
+    return [](Event* event) {
+        static_cast<T*>(event)->~T();
+    };
+}
+
+// Fixed-size inline storage for one queued event, shared by the slot based queues. Events larger than a slot go
+// through an EventPool and are held by pointer.
+struct EventSlot {
+    public:
+        static constexpr std::size_t SIZE = 96;
+        template<typename T>
+        static constexpr bool fits = sizeof(T) <= SIZE && alignof(T) <= alignof(std::max_align_t);
+
+        template<typename T, typename... Args>
+        T* emplace(Args&&... args) {
+            static_assert(fits<T>, "Event is too large or over-aligned for a queue slot - submit it from an EventPool");
+            auto event = new (m_storage) T(std::forward<Args>(args)...);
+            m_event = event;
+            m_release = destroy_in_place<T>();
+            return event;
+        }
+        // holds an event stored elsewhere, see EventPool - `release` is called on it instead of its destructor
+        void hold(Event& event, EventRelease release) {
+            m_event = &event;
+            m_release = release;
+        }
+        [[nodiscard]] inline Event& get_event() const {
+            return *m_event;
+        }
+        // ends the held event's time in the queue
+        void release() {
+            m_release(m_event);
+        }
+    private:
+        EventRelease m_release { nullptr };
+        Event* m_event { nullptr };
+        alignas(std::max_align_t) std::byte m_storage[SIZE];
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "event_slot.h"
+
+// FIFO of heterogeneous events. Every record is bump-allocated into a reusable block and holds the
+// concrete event object, so derived events keep their payload and no event is ever sliced.
+// Blocks are kept after the stream drains, so a warm stream does not touch the allocator at all.
+struct EventStream {
+    public:
+        EventStream() = default;
+        EventStream(EventStream const&) = delete;
+        void operator=(EventStream const&) = delete;
+        ~EventStream() {
+            clear();
+        }
+        template<typename T, typename... Args>
+        T& emplace(Args&&... args) {
+            static_assert(alignof(T) <= RECORD_ALIGNMENT, "Over-aligned events are not supported");
+            auto size = align(sizeof(RecordHeader)) + align(sizeof(T));
+            auto record = allocate(size);
+            auto event = new (record + align(sizeof(RecordHeader))) T(std::forward<Args>(args)...);
+            new (record) RecordHeader { destroy_in_place<T>(), event, size };
+            return *event;
+        }
+        // queues an event stored elsewhere, see EventSlot::hold
+        Event& push(Event& event, EventRelease release) {
+            auto size = align(sizeof(RecordHeader));
+            new (allocate(size)) RecordHeader { release, &event, size };
+            return event;
+        }
+        [[nodiscard]] inline Event& front() {
+            assert(!empty() && "Cannot read from an empty stream");
+            return *current()->event;
+        }
+        void pop() {
+            assert(!empty() && "Cannot pop from an empty stream");
+            auto header = current();
+            header->release(header->event);
+            m_read_offset += header->size;
+            if (m_read_offset == m_blocks[m_read].used) {
+                if (m_read == m_write) {
+                    // drained - rewind so the blocks are reused from the start
+                    for (std::size_t i = 0; i <= m_write; i++) {
+                        m_blocks[i].used = 0;
+                    }
+                    m_read = m_write = 0;
+                } else {
+                    m_read++;
+                }
+                m_read_offset = 0;
+            }
+        }
+        [[nodiscard]] inline bool empty() const {
+            return m_blocks.empty() || (m_read == m_write && m_read_offset == m_blocks[m_write].used);
+        }
+        void clear() {
+            while (!empty()) {
+                pop();
+            }
+        }
+        // exchanges contents and blocks - neither stream reallocates
+        void swap(EventStream& other) noexcept {
+            std::swap(m_blocks, other.m_blocks);
+            std::swap(m_write, other.m_write);
+            std::swap(m_read, other.m_read);
+            std::swap(m_read_offset, other.m_read_offset);
+        }
+    private:
+        struct RecordHeader {
+            EventRelease release;
+            Event* event;
+            std::size_t size;
+        };
+        struct Block {
+            std::unique_ptr<std::byte[]> data;
+            std::size_t capacity;
+            std::size_t used;
+        };
+        static constexpr std::size_t RECORD_ALIGNMENT = alignof(std::max_align_t);
+        static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+        static constexpr std::size_t align(std::size_t size) {
+            return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+        }
+        inline RecordHeader* current() {
+            return reinterpret_cast<RecordHeader*>(m_blocks[m_read].data.get() + m_read_offset);
+        }
+        std::byte* allocate(std::size_t size) {
+            if (m_blocks.empty()) {
+                m_blocks.push_back(make_block(size));
+            } else if (m_blocks[m_write].used == 0 && m_blocks[m_write].capacity < size) {
+                // the stream is empty and reads from this block too - put a large enough one in front of it rather
+                // than moving the write block away from the read block
+                m_blocks.insert(m_blocks.begin() + static_cast<std::ptrdiff_t>(m_write), make_block(size));
+            } else if (m_blocks[m_write].capacity - m_blocks[m_write].used < size) {
+                // blocks past the write block are always empty - reuse the next one if the record fits
+                m_write++;
+                if (m_write == m_blocks.size()) {
+                    m_blocks.push_back(make_block(size));
+                } else if (m_blocks[m_write].capacity < size) {
+                    m_blocks.insert(m_blocks.begin() + static_cast<std::ptrdiff_t>(m_write), make_block(size));
+                }
+            }
+            auto& block = m_blocks[m_write];
+            auto record = block.data.get() + block.used;
+            block.used += size;
+            return record;
+        }
+        static Block make_block(std::size_t size) {
+            auto capacity = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+            return Block { std::make_unique<std::byte[]>(capacity), capacity, 0 };
+        }
+    private:
+        std::vector<Block> m_blocks {};
+        // block currently written to, block currently read from and the read position inside it
+        std::size_t m_write { 0 };
+        std::size_t m_read { 0 };
+        std::size_t m_read_offset { 0 };
+};
@@ -0,0 +1,7 @@
+#pragma once
+
+// everything needed to define events and handlers and to run a bus
+#include "event.h"
+#include "event_bus.h"
+#include "event_handler.h"
+#include "sharded_event_bus.h"
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "event.h"
+
+// only compiled in with EVENT_SYSTEM_INSTRUMENTATION defined, see EventBus::get_stats
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+// Log-linear latency histogram in the style of HdrHistogram. Values below 16ns are exact, above that every power
+// of two is split into 8 linear sub-buckets (12.5% precision) up to ~68s.
+struct LatencyHistogram {
+    public:
+        void record(std::uint64_t nanoseconds) {
+            m_counts[bucket(nanoseconds)]++;
+            m_count++;
+            m_sum += nanoseconds;
+            m_max = std::max(m_max, nanoseconds);
+        }
+        void merge(const LatencyHistogram& other) {
+            for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+                m_counts[i] += other.m_counts[i];
+            }
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_max = std::max(m_max, other.m_max);
+        }
+        [[nodiscard]] inline std::uint64_t count() const {
+            return m_count;
+        }
+        [[nodiscard]] inline std::uint64_t max() const {
+            return m_max;
+        }
+        [[nodiscard]] inline double mean() const {
+            return m_count == 0 ? 0.0 : static_cast<double>(m_sum) / static_cast<double>(m_count);
+        }
+        // highest value equivalent to the given percentile (0-100) of the recorded values
+        [[nodiscard]] std::uint64_t percentile(double percentile) const {
+            auto target = static_cast<std::uint64_t>(percentile / 100.0 * static_cast<double>(m_count) + 0.5);
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < BUCKET_COUNT; i++) {
+                seen += m_counts[i];
+                if (seen >= target && seen > 0) {
+                    return std::min(highest_equivalent(i), m_max);
+                }
+            }
+            return 0;
+        }
+    private:
+        static constexpr unsigned SUB_BUCKET_BITS = 3;
+        static constexpr std::uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr unsigned MAX_BITS = 36;
+        static constexpr std::size_t BUCKET_COUNT = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+        static std::size_t bucket(std::uint64_t value) {
+            value = std::min(value, (std::uint64_t { 1 } << MAX_BITS) - 1);
+            if (value < 2 * SUB_BUCKETS) {
+                return value;
+            }
+            auto shift = static_cast<unsigned>(std::bit_width(value)) - (SUB_BUCKET_BITS + 1);
+            return shift * SUB_BUCKETS + (value >> shift);
+        }
+        static std::uint64_t highest_equivalent(std::size_t bucket) {
+            if (bucket < 2 * SUB_BUCKETS) {
+                return bucket;
+            }
+            auto shift = bucket / SUB_BUCKETS - 1;
+            auto lowest = (bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+            return lowest + (std::uint64_t { 1 } << shift) - 1;
+        }
+    private:
+        std::array<std::uint64_t, BUCKET_COUNT> m_counts {};
+        std::uint64_t m_count { 0 };
+        std::uint64_t m_sum { 0 };
+        std::uint64_t m_max { 0 };
+};
+// calls, stopped propagations and time spent in handlers - per subscription, and summed up per event type
+struct HandlerCallStats {
+    std::uint64_t invocations { 0 };
+    std::uint64_t stopped_propagation { 0 };
+    LatencyHistogram time {};
+
+    void record(std::chrono::steady_clock::duration elapsed, bool stopped) {
+        invocations++;
+        stopped_propagation += stopped;
+        time.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+};
+
+
+// snapshot of the instrumentation of a bus, see EventBus::get_stats
+struct DispatchStats {
+    struct Handler {
+        // object the handler delegate calls, the EventHandler base for EventHandler subclasses
+        const void* handler;
+        EventTypeId type;
+        HandlerCallStats calls;
+    };
+    struct EventType {
+        // events dispatched one at a time - batched dispatch only shows up in the handler calls
+        std::uint64_t dispatched { 0 };
+        HandlerCallStats calls {};
+    };
+    struct QueueDepth {
+        std::size_t peak { 0 };
+        std::uint64_t samples { 0 };
+        std::uint64_t total { 0 };
+
+        [[nodiscard]] inline double average() const {
+            return samples == 0 ? 0.0 : static_cast<double>(total) / static_cast<double>(samples);
+        }
+    };
+    std::array<EventType, EVENT_TYPE_COUNT> event_types {};
+    // handlers registered when the snapshot was taken
+    std::vector<Handler> handlers {};
+    // sampled on every single-threaded push and at the start of every multi-producer drain
+    QueueDepth queue_depth {};
+};
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Fixed-block pool of records. Records are carved out of contiguous chunks and recycled through an intrusive
+// free list, so subscribing never touches the global allocator once warm. Chunks are released all at once
+// together with the pool.
+template<typename T>
+struct NodePool {
+    public:
+        NodePool() = default;
+        NodePool(NodePool const&) = delete;
+        void operator=(NodePool const&) = delete;
+        template<typename... Args>
+        T* acquire(Args&&... args) {
+            if (m_free == nullptr) {
+                grow();
+            }
+            auto slot = m_free;
+            m_free = slot->next;
+            return new (slot->storage) T { std::forward<Args>(args)... };
+        }
+        void release(T* record) {
+            record->~T();
+            auto slot = reinterpret_cast<Slot*>(record);
+            slot->next = m_free;
+            m_free = slot;
+        }
+    private:
+        union Slot {
+            Slot* next;
+            alignas(T) std::byte storage[sizeof(T)];
+        };
+        void grow() {
+            auto chunk = std::make_unique<Slot[]>(CHUNK_SIZE);
+            // thread the new slots onto the free list in address order
+            for (std::size_t i = 0; i < CHUNK_SIZE - 1; i++) {
+                chunk[i].next = &chunk[i + 1];
+            }
+            chunk[CHUNK_SIZE - 1].next = m_free;
+            m_free = &chunk[0];
+            m_chunks.push_back(std::move(chunk));
+        }
+    private:
+        static constexpr std::size_t CHUNK_SIZE = 256;
+        std::vector<std::unique_ptr<Slot[]>> m_chunks {};
+        Slot* m_free { nullptr };
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "event_bus.h"
+#include "event_stream.h"
+#include "spsc_ring.h"
+
+// A set of independent EventBus shards, each with its own queue, handler tables and thread. Events are routed by
+// a key such as an entity or session id, so everything about one key is handled on one thread and shards never
+// share state. Handlers subscribe to the shard that owns their keys, see shard_of and get_shard.
+// Events posted from outside the shards go into the shard's multi-producer queue. Events a shard posts to another
+// one are collected per destination and handed over in batches through single-producer single-consumer
+// mailboxes, so shards forwarding to each other do not contend on a shared queue. Events a shard posts to itself
+// skip the queue as well. Both are dispatched in rounds, ahead of the shard's queue.
+// Handlers of a shard are created and destroyed while the shards are stopped, or on the shard's own thread.
+struct ShardedEventBus {
+    public:
+        // `capacity` is the size of each shard's multi-producer queue lanes
+        explicit ShardedEventBus(std::size_t shards, std::size_t capacity = DEFAULT_SHARD_CAPACITY) {
+            assert(shards > 0 && "A sharded bus needs at least one shard");
+            m_shards.reserve(shards);
+            for (std::size_t i = 0; i < shards; i++) {
+                auto shard = std::make_unique<Shard>();
+                shard->bus.set_queue_mode(QueueMode::MultiProducer, capacity);
+                shard->incoming.resize(shards);
+                for (std::size_t from = 0; from < shards; from++) {
+                    if (from != i) {
+                        shard->incoming[from] = std::make_unique<Mailbox>();
+                    }
+                }
+                m_shards.push_back(std::move(shard));
+            }
+        }
+        ShardedEventBus(ShardedEventBus const&) = delete;
+        void operator=(ShardedEventBus const&) = delete;
+        ~ShardedEventBus() {
+            stop();
+        }
+        [[nodiscard]] inline std::size_t get_shard_count() const {
+            return m_shards.size();
+        }
+        // the shard handling events posted with `key`
+        [[nodiscard]] inline std::size_t shard_of(std::uint64_t key) const {
+            return static_cast<std::size_t>(key % m_shards.size());
+        }
+        [[nodiscard]] inline EventBus& get_shard(std::size_t index) {
+            return m_shards[index]->bus;
+        }
+        // starts one thread per shard, which dispatches until stop is called
+        void start() {
+            assert(!is_running() && "The shards are already running");
+            m_stopping.store(false, std::memory_order_relaxed);
+            for (std::size_t i = 0; i < m_shards.size(); i++) {
+                m_shards[i]->thread = std::thread([this, i]() {
+                    run(i);
+                });
+            }
+        }
+        // joins the shard threads. Events not dispatched yet stay queued until the next start, or are dropped
+        // with the bus.
+        void stop() {
+            m_stopping.store(true, std::memory_order_release);
+            for (auto& shard : m_shards) {
+                if (shard->thread.joinable()) {
+                    shard->thread.join();
+                }
+            }
+        }
+        [[nodiscard]] inline bool is_running() const {
+            return !m_shards.empty() && m_shards.front()->thread.joinable();
+        }
+        // queues the event on the shard owning `key`. Safe to call from any thread - returns false if the event
+        // was dropped because the shard's queue is full. Posts made by the shards themselves never fail. Posts from
+        // other threads go through the multi-producer queue, which only takes events that fit its slots.
+        template<typename T>
+        bool post(std::uint64_t key, T&& event) {
+            auto target = shard_of(key);
+            auto& here = current();
+            if (here.bus != this) {
+                return m_shards[target]->bus.push_to_queue(std::forward<T>(event));
+            }
+            // a shard posting to itself keeps the event in a plain stream - nothing else touches it
+            auto& stream = here.shard == target ? m_shards[target]->local : *m_shards[target]->incoming[here.shard]->outbox;
+            stream.template emplace<std::decay_t<T>>(std::forward<T>(event));
+            return true;
+        }
+    private:
+        // events one shard sends another. The sender fills `outbox` and publishes it as a whole once the receiver
+        // has handed back a drained stream, so a burst costs two ring operations rather than one per event.
+        struct Mailbox {
+            static constexpr std::size_t STREAMS = 4;
+
+            Mailbox() : outbox(&streams[0]) {
+                for (std::size_t i = 1; i < STREAMS; i++) {
+                    drained.try_push(&streams[i]);
+                }
+            }
+            std::array<EventStream, STREAMS> streams {};
+            // written by the sender only
+            EventStream* outbox;
+            // sender to receiver
+            SpscRing<EventStream*, STREAMS> filled {};
+            // receiver to sender
+            SpscRing<EventStream*, STREAMS> drained {};
+        };
+        struct Shard {
+            EventBus bus {};
+            // incoming[from] is written by shard `from` - null for the shard itself
+            std::vector<std::unique_ptr<Mailbox>> incoming {};
+            // events the shard posted to itself, and those of them the current round dispatches
+            EventStream local {};
+            EventStream local_round {};
+            std::thread thread {};
+        };
+        // the shard the calling thread runs, if any
+        struct Current {
+            ShardedEventBus* bus { nullptr };
+            std::size_t shard { 0 };
+        };
+        static Current& current() {
+            thread_local Current current {};
+            return current;
+        }
+        void run(std::size_t index) {
+            current() = { this, index };
+            auto& shard = *m_shards[index];
+            std::size_t idle = 0;
+            while (!m_stopping.load(std::memory_order_acquire)) {
+                auto dispatched = receive(shard);
+                dispatched += shard.bus.process_queue(std::numeric_limits<std::size_t>::max());
+                send(index);
+                if (dispatched > 0) {
+                    idle = 0;
+                } else if (++idle < IDLE_SPIN_LIMIT) {
+                    std::this_thread::yield();
+                } else {
+                    // nothing came in for a while - stop burning the core, at the cost of some wake up latency
+                    std::this_thread::sleep_for(IDLE_SLEEP);
+                }
+            }
+            current() = {};
+        }
+        // dispatches what the shard posted to itself and the batches other shards have published to it, handing
+        // their streams back. Only what was there when the round started is dispatched - events posted meanwhile
+        // wait for the next round, so handlers that keep posting cannot hold the shard here and stop stays responsive
+        static std::size_t receive(Shard& shard) {
+            std::size_t dispatched = 0;
+            shard.local_round.swap(shard.local);
+            while (!shard.local_round.empty()) {
+                shard.bus.dispatch_now(shard.local_round.front());
+                shard.local_round.pop();
+                dispatched++;
+            }
+            for (auto& mailbox : shard.incoming) {
+                EventStream* stream;
+                // at most the batches published so far - the sender refills the streams handed back
+                for (std::size_t i = 0; i < Mailbox::STREAMS && mailbox != nullptr && mailbox->filled.try_pop(stream); i++) {
+                    while (!stream->empty()) {
+                        shard.bus.dispatch_now(stream->front());
+                        stream->pop();
+                        dispatched++;
+                    }
+                    mailbox->drained.try_push(stream);
+                }
+            }
+            return dispatched;
+        }
+        // publishes the outboxes of shard `from` - an outbox whose receiver still holds every other stream keeps
+        // filling until the next round
+        void send(std::size_t from) {
+            for (auto& shard : m_shards) {
+                auto& mailbox = shard->incoming[from];
+                EventStream* fresh;
+                if (mailbox != nullptr && !mailbox->outbox->empty() && mailbox->drained.try_pop(fresh)) {
+                    mailbox->filled.try_push(mailbox->outbox);
+                    mailbox->outbox = fresh;
+                }
+            }
+        }
+    private:
+        static constexpr std::size_t DEFAULT_SHARD_CAPACITY = 1 << 14;
+        static constexpr std::size_t IDLE_SPIN_LIMIT = 1024;
+        static constexpr std::chrono::microseconds IDLE_SLEEP { 100 };
+        std::vector<std::unique_ptr<Shard>> m_shards {};
+        std::atomic<bool> m_stopping { false };
+};
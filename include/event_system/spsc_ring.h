@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer single-consumer ring of trivially copyable values. Each side only writes its own
+// position, so neither ever waits on the other - a full or empty ring is reported instead.
+template<typename T, std::size_t Capacity>
+struct SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    public:
+        // producer side - returns false if the ring is full
+        bool try_push(T value) {
+            auto tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+                return false;
+            }
+            m_items[tail & (Capacity - 1)] = value;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        // consumer side - returns false if the ring is empty
+        bool try_pop(T& value) {
+            auto head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = m_items[head & (Capacity - 1)];
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+    private:
+        std::array<T, Capacity> m_items {};
+        // the positions sit on their own cache lines, so producer and consumer do not invalidate each other
+        alignas(64) std::atomic<std::size_t> m_head { 0 };
+        alignas(64) std::atomic<std::size_t> m_tail { 0 };
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+template<typename... Ts>
+struct TypeList {
+    static constexpr std::size_t size = sizeof...(Ts);
+};
+template<typename T, typename List>
+struct TypeIndex;
+template<typename T>
+struct TypeIndex<T, TypeList<>> {
+    static_assert(!std::is_same_v<T, T>, "Event type is not listed in EventRegistry");
+};
+template<typename T, typename... Ts>
+struct TypeIndex<T, TypeList<T, Ts...>> : std::integral_constant<std::size_t, 0> { };
+template<typename T, typename U, typename... Ts>
+struct TypeIndex<T, TypeList<U, Ts...>> : std::integral_constant<std::size_t, 1 + TypeIndex<T, TypeList<Ts...>>::value> { };
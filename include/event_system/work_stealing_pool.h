@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of threads that EventBus spreads parallel handlers over. parallel_for cuts its range into tasks dealt
+// out to one deque per thread - a thread works through its own deque newest first and steals the oldest task of
+// another one when it runs dry, so handlers of uneven cost still even out. The calling thread takes part, and
+// parallel_for only returns once every task is done.
+struct WorkStealingPool {
+    public:
+        // `threads` includes the calling thread - a pool of one runs everything inline
+        explicit WorkStealingPool(std::size_t threads) : m_deques(threads) {
+            assert(threads > 0 && "A pool needs at least the calling thread");
+            for (auto& deque : m_deques) {
+                deque = std::make_unique<TaskDeque>();
+            }
+            m_workers.reserve(threads - 1);
+            for (std::size_t i = 1; i < threads; i++) {
+                m_workers.emplace_back([this, i]() {
+                    work(i);
+                });
+            }
+        }
+        WorkStealingPool(WorkStealingPool const&) = delete;
+        void operator=(WorkStealingPool const&) = delete;
+        ~WorkStealingPool() {
+            {
+                std::lock_guard<std::mutex> lock(m_sleep_mutex);
+                m_stopping = true;
+            }
+            m_wake.notify_all();
+            for (auto& worker : m_workers) {
+                worker.join();
+            }
+        }
+        [[nodiscard]] inline std::size_t get_thread_count() const {
+            return m_deques.size();
+        }
+        // calls function(i) for every i in [0, count), on any of the pool's threads. Must not be called from a task.
+        template<typename Function>
+        void parallel_for(std::size_t count, Function&& function) {
+            auto threads = m_deques.size();
+            if (threads == 1 || count < 2) {
+                for (std::size_t i = 0; i < count; i++) {
+                    function(i);
+                }
+                return;
+            }
+            // a few tasks per thread leave something to steal when some calls take longer than others
+            auto tasks = std::min(count, threads * TASKS_PER_THREAD);
+            Job job { [](void* target, std::size_t index) {
+                (*static_cast<std::remove_reference_t<Function>*>(target))(index);
+            }, &function, tasks };
+            {
+                // counted before they are visible, so a thread that sees zero under the lock can safely sleep
+                std::lock_guard<std::mutex> lock(m_sleep_mutex);
+                m_queued.fetch_add(tasks, std::memory_order_relaxed);
+            }
+            for (std::size_t t = 0; t < tasks; t++) {
+                auto& deque = *m_deques[t % threads];
+                std::lock_guard<std::mutex> lock(deque.mutex);
+                deque.tasks.push_back({ &job, count * t / tasks, count * (t + 1) / tasks });
+            }
+            m_wake.notify_all();
+            // help out until every task is done - tasks still running elsewhere leave nothing to take
+            Task task;
+            while (job.remaining.load(std::memory_order_acquire) > 0) {
+                if (take(0, task)) {
+                    run(task);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    private:
+        // one parallel_for call - lives on the calling thread's stack until `remaining` drops to zero
+        struct Job {
+            void (*call)(void* function, std::size_t index);
+            void* function;
+            std::atomic<std::size_t> remaining;
+        };
+        struct Task {
+            Job* job;
+            std::size_t begin;
+            std::size_t end;
+        };
+        struct alignas(64) TaskDeque {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+        // the newest task of the thread's own deque, otherwise the oldest one of the next deque that has any
+        bool take(std::size_t self, Task& task) {
+            if (m_queued.load(std::memory_order_relaxed) == 0) {
+                return false;
+            }
+            for (std::size_t step = 0; step < m_deques.size(); step++) {
+                auto& deque = *m_deques[(self + step) % m_deques.size()];
+                std::lock_guard<std::mutex> lock(deque.mutex);
+                if (deque.tasks.empty()) {
+                    continue;
+                }
+                if (step == 0) {
+                    task = deque.tasks.back();
+                    deque.tasks.pop_back();
+                } else {
+                    task = deque.tasks.front();
+                    deque.tasks.pop_front();
+                }
+                m_queued.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+        static void run(const Task& task) {
+            for (auto i = task.begin; i < task.end; i++) {
+                task.job->call(task.job->function, i);
+            }
+            // last touch of the job - the caller may return right after
+            task.job->remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        void work(std::size_t self) {
+            Task task;
+            std::size_t idle = 0;
+            while (true) {
+                if (take(self, task)) {
+                    run(task);
+                    idle = 0;
+                } else if (++idle < SPIN_LIMIT) {
+                    // events tend to come in bursts - stay awake for the next one for a little while
+                    std::this_thread::yield();
+                } else {
+                    std::unique_lock<std::mutex> lock(m_sleep_mutex);
+                    m_wake.wait(lock, [this]() {
+                        return m_stopping || m_queued.load(std::memory_order_relaxed) > 0;
+                    });
+                    if (m_stopping) {
+                        return;
+                    }
+                    idle = 0;
+                }
+            }
+        }
+    private:
+        static constexpr std::size_t TASKS_PER_THREAD = 4;
+        static constexpr std::size_t SPIN_LIMIT = 64;
+        // deque 0 belongs to the thread calling parallel_for, the others to m_workers in order
+        std::vector<std::unique_ptr<TaskDeque>> m_deques;
+        std::vector<std::thread> m_workers {};
+        // tasks sitting in the deques
+        std::atomic<std::size_t> m_queued { 0 };
+        std::mutex m_sleep_mutex {};
+        std::condition_variable m_wake {};
+        bool m_stopping { false };
+};
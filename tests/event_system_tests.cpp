@@ -0,0 +1,763 @@
+#include <array>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "event_system/event_system.h"
+
+// Behaviour tests for the parts of the bus that handle memory and threads in non-obvious ways. They are built under
+// AddressSanitizer and under ThreadSanitizer, so a test only passes if it is free of memory errors and races too.
+
+struct ValueEvent : public Event {
+    explicit ValueEvent(int value) : Event(event_type_id<ValueEvent>), value(value) { }
+    int value;
+};
+// larger than an EventSlot
+struct LargeEvent : public Event {
+    LargeEvent() : Event(event_type_id<LargeEvent>) { }
+    int value { 0 };
+    std::array<char, 512> payload {};
+};
+
+static int g_failures = 0;
+
+#define CHECK(condition)                                                              \
+    do {                                                                              \
+        if (!(condition)) {                                                           \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            g_failures++;                                                             \
+        }                                                                             \
+    } while (false)
+
+// sums the values of the events it sees
+struct ValueSum : public EventHandler<ValueSum, ValueEvent, LargeEvent> {
+    using EventHandler::EventHandler;
+    bool handle(const Event& event) {
+        sum += event.is_type<ValueEvent>() ? static_cast<const ValueEvent&>(event).value : static_cast<const LargeEvent&>(event).value;
+        calls++;
+        return false;
+    }
+    std::atomic<long> sum { 0 };
+    std::atomic<long> calls { 0 };
+};
+// the bus points into a connected handler, which therefore stays where it is
+static_assert(!std::is_copy_constructible_v<ValueSum> && !std::is_move_constructible_v<ValueSum>);
+static_assert(!std::is_copy_assignable_v<ValueSum> && !std::is_move_assignable_v<ValueSum>);
+
+// a large record arriving at a drained stream must not be read from a stale block
+static void stream_rewinds_around_large_records() {
+    struct HugeEvent : public ValueEvent {
+        HugeEvent() : ValueEvent(7) { }
+        std::array<char, 100000> payload {};
+    };
+    EventStream stream;
+    stream.emplace<ValueEvent>(1);
+    stream.pop();
+    stream.emplace<HugeEvent>();
+    CHECK(!stream.empty() && static_cast<ValueEvent&>(stream.front()).value == 7);
+    stream.pop();
+    stream.emplace<ValueEvent>(2);
+    stream.emplace<HugeEvent>();
+    stream.pop();
+    CHECK(static_cast<ValueEvent&>(stream.front()).value == 7);
+    stream.pop();
+    CHECK(stream.empty());
+}
+
+// events larger than a ring slot spill over on a growing bus and keep their order
+static void bounded_bus_handles_large_events() {
+    EventBus bus(2, OverflowPolicy::Grow);
+    ValueSum handler(bus);
+    CHECK(bus.emplace<ValueEvent>(1));
+    CHECK(bus.emplace<LargeEvent>());
+    CHECK(bus.emplace<ValueEvent>(2));
+    bus.process_queue();
+    CHECK(handler.calls == 3 && handler.sum == 3);
+#ifdef NDEBUG
+    // a bus that does not grow rejects them before its overflow policy evicts anything
+    EventBus dropping(2, OverflowPolicy::DropOldest);
+    ValueSum kept(dropping);
+    dropping.emplace<ValueEvent>(1);
+    dropping.emplace<ValueEvent>(2);
+    CHECK(!dropping.emplace<LargeEvent>());
+    dropping.process_queue();
+    CHECK(kept.calls == 2 && kept.sum == 3);
+#endif
+}
+
+// every overflow policy of a single-threaded bounded bus, in push order
+static void bounded_bus_applies_its_overflow_policy() {
+    auto run = [](OverflowPolicy overflow, int pushes, std::vector<bool>& accepted) {
+        EventBus bus(4, overflow);
+        std::vector<int> seen;
+        auto token = bus.subscribe<ValueEvent>([&seen](const ValueEvent& event) {
+            seen.push_back(event.value);
+        });
+        for (int i = 1; i <= pushes; i++) {
+            accepted.push_back(bus.emplace<ValueEvent>(i));
+        }
+        bus.process_queue();
+        CHECK(bus.get_dropped_events() == (overflow == OverflowPolicy::Grow ? 0 : static_cast<std::size_t>(pushes - 4)));
+        return seen;
+    };
+    std::vector<bool> accepted;
+    CHECK((run(OverflowPolicy::DropNewest, 6, accepted) == std::vector<int> { 1, 2, 3, 4 }));
+    CHECK((accepted == std::vector<bool> { true, true, true, true, false, false }));
+    accepted.clear();
+    CHECK((run(OverflowPolicy::DropOldest, 6, accepted) == std::vector<int> { 3, 4, 5, 6 }));
+    CHECK((accepted == std::vector<bool>(6, true)));
+    accepted.clear();
+    CHECK((run(OverflowPolicy::Grow, 7, accepted) == std::vector<int> { 1, 2, 3, 4, 5, 6, 7 }));
+
+    // once a lane has grown, pushes queue behind the spilled events even if the ring has room again
+    EventBus growing(2, OverflowPolicy::Grow);
+    std::vector<int> seen;
+    auto token = growing.subscribe<ValueEvent>([&seen](const ValueEvent& event) {
+        seen.push_back(event.value);
+    });
+    for (int i = 1; i <= 4; i++) {
+        growing.emplace<ValueEvent>(i);
+    }
+    CHECK(growing.process_queue(1) == 1);
+    growing.emplace<ValueEvent>(5);
+    growing.process_queue();
+    CHECK((seen == std::vector<int> { 1, 2, 3, 4, 5 }));
+
+    // while handlers run the oldest event may be the one being dispatched - the pushed one is dropped instead
+    EventBus dropping(2, OverflowPolicy::DropOldest);
+    seen.clear();
+    auto pushing = dropping.subscribe<ValueEvent>([&](const ValueEvent& event) {
+        seen.push_back(event.value);
+        if (event.value == 1) {
+            CHECK(!dropping.emplace<ValueEvent>(10));
+        }
+    });
+    dropping.emplace<ValueEvent>(1);
+    dropping.emplace<ValueEvent>(2);
+    dropping.process_queue();
+    CHECK((seen == std::vector<int> { 1, 2 }));
+    CHECK(dropping.get_dropped_events() == 1);
+}
+
+// a bounded bus keeps its capacity in multi-producer mode, where blocking producers wait for the consumer
+static void bounded_bus_keeps_its_capacity_across_modes() {
+    EventBus dropping(8, OverflowPolicy::DropNewest);
+    dropping.set_queue_mode(QueueMode::MultiProducer);
+    ValueSum kept(dropping);
+    for (int i = 0; i < 8; i++) {
+        CHECK(dropping.emplace<ValueEvent>(1));
+    }
+    CHECK(!dropping.emplace<ValueEvent>(1));
+    dropping.process_queue();
+    CHECK(kept.calls == 8);
+
+    EventBus blocking(8, OverflowPolicy::Block, QueueMode::MultiProducer);
+    ValueSum handler(blocking);
+    std::atomic<int> pushed { 0 };
+    std::thread producer([&]() {
+        for (int i = 0; i < 20; i++) {
+            blocking.emplace<ValueEvent>(1);
+            pushed++;
+        }
+    });
+    while (pushed < 8) {
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(pushed == 8);
+    while (handler.calls < 20) {
+        blocking.process_queue();
+    }
+    producer.join();
+    CHECK(handler.sum == 20);
+}
+
+// producers push through the lock-free queue while the consumer dispatches
+static void multi_producer_queue_delivers_everything() {
+    constexpr int PRODUCERS = 4;
+    constexpr int EVENTS = 20000;
+    EventBus bus;
+    bus.set_queue_mode(QueueMode::MultiProducer, 256);
+    ValueSum handler(bus);
+    // large events travel by pointer, from a pool per producer that outlives the queue's use of them
+    std::vector<std::unique_ptr<EventPool<LargeEvent>>> pools;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        auto& pool = *pools.emplace_back(std::make_unique<EventPool<LargeEvent>>(16, LargeEvent()));
+        producers.emplace_back([&bus, &pool]() {
+            for (int i = 0; i < EVENTS; i++) {
+                if (i % 8 == 0) {
+                    LargeEvent* event;
+                    while ((event = pool.acquire()) == nullptr) {
+                        std::this_thread::yield();
+                    }
+                    event->value = 1;
+                    while (!bus.submit(event)) {
+                        std::this_thread::yield();
+                    }
+                } else {
+                    while (!bus.emplace<ValueEvent>(1)) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        });
+    }
+    while (handler.calls < PRODUCERS * EVENTS) {
+        bus.process_queue(1000);
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    CHECK(handler.sum == PRODUCERS * EVENTS);
+}
+
+// handlers and callables come and go on other threads while the bus dispatches
+static void concurrent_registration_while_dispatching() {
+    // connects late and disconnects early, so it is never called half constructed
+    struct Churned : public EventHandler<Churned, ValueEvent> {
+        explicit Churned(EventBus& bus) : EventHandler(bus, 0, HandlerConnection::Deferred) {
+            alive = true;
+            connect();
+        }
+        ~Churned() override {
+            disconnect();
+            alive = false;
+        }
+        bool handle(const Event&) {
+            CHECK(alive);
+            return false;
+        }
+        bool alive { false };
+    };
+    constexpr int THREADS = 3;
+    constexpr int ROUNDS = 300;
+    EventBus bus;
+    bus.set_concurrent_registration(true);
+    std::atomic<int> finished { 0 };
+    std::atomic<long> calls { 0 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&]() {
+            std::vector<std::unique_ptr<Churned>> handlers;
+            std::vector<SubscriptionToken> tokens;
+            for (int i = 0; i < ROUNDS; i++) {
+                handlers.push_back(std::make_unique<Churned>(bus));
+                tokens.push_back(bus.subscribe<ValueEvent>([&calls](const ValueEvent&) {
+                    calls++;
+                }));
+                if (handlers.size() > 4) {
+                    handlers.erase(handlers.begin());
+                    tokens.erase(tokens.begin());
+                }
+            }
+            finished++;
+        });
+    }
+    while (finished < THREADS) {
+        for (int i = 0; i < 16; i++) {
+            bus.push_to_queue(ValueEvent(i));
+        }
+        bus.process_queue();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// dispatch reads published tables, so registering goes on while a handler blocks - and unregistering from another
+// thread returns only once the call it may race with is over
+static void concurrent_registration_waits_only_for_the_running_call() {
+    // bounds every wait, so a regression fails instead of hanging
+    auto wait_for = [](const std::atomic<bool>& flag) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!flag && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        return flag.load();
+    };
+    EventBus bus;
+    bus.set_concurrent_registration(true);
+    std::atomic<bool> entered { false };
+    std::atomic<bool> release { false };
+    std::atomic<bool> returned { false };
+    auto blocking = bus.subscribe<ValueEvent>([&](const ValueEvent&) {
+        entered = true;
+        wait_for(release);
+        returned = true;
+    });
+    bus.push_to_queue(ValueEvent(1));
+    std::thread dispatcher([&]() {
+        bus.process_queue();
+    });
+    CHECK(wait_for(entered));
+    // neither waits for the blocked handler, and neither sees the event in flight
+    ValueSum registered(bus);
+    auto token = bus.subscribe<ValueEvent>([](const ValueEvent&) { });
+    std::atomic<bool> unsubscribed { false };
+    std::thread unsubscriber([&]() {
+        blocking.reset();
+        CHECK(returned);
+        unsubscribed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!unsubscribed);
+    release = true;
+    unsubscriber.join();
+    dispatcher.join();
+    CHECK(unsubscribed);
+    CHECK(registered.calls == 0);
+}
+
+// a handler destroying another one during dispatch returns right away, and the destroyed one is not called any more
+static void concurrent_registration_skips_handlers_destroyed_during_dispatch() {
+    EventBus bus;
+    bus.set_concurrent_registration(true);
+    auto later = std::make_unique<ValueSum>(bus, -1);
+    auto first = bus.subscribe<ValueEvent>([&](const ValueEvent&) {
+        later.reset();
+    }, 1);
+    bus.dispatch_now(ValueEvent(1));
+    CHECK(later == nullptr);
+    // batched dispatch skips them as well
+    later = std::make_unique<ValueSum>(bus, -1);
+    bus.push_to_queue(ValueEvent(2));
+    bus.process_queue_batched();
+    CHECK(later == nullptr);
+}
+
+// parallel handlers spread over the pool, sequential ones around them still see every event once
+static void parallel_handlers_run_on_the_pool() {
+    struct Parallel : public EventHandler<Parallel, ValueEvent> {
+        explicit Parallel(EventBus& bus) : EventHandler(bus) {
+            set_execution(HandlerExecution::Parallel);
+        }
+        bool handle(const Event&) {
+            calls++;
+            return false;
+        }
+        std::atomic<long> calls { 0 };
+    };
+    EventBus bus;
+    bus.set_worker_threads(4);
+    std::vector<std::unique_ptr<Parallel>> parallel;
+    for (int i = 0; i < 8; i++) {
+        parallel.push_back(std::make_unique<Parallel>(bus));
+    }
+    ValueSum after(bus, -1);
+    for (int i = 0; i < 500; i++) {
+        bus.push_to_queue(ValueEvent(1));
+    }
+    bus.process_queue();
+    for (auto& handler : parallel) {
+        CHECK(handler->calls == 500);
+    }
+    CHECK(after.sum == 500);
+}
+
+// events hop from shard to shard until their hops run out
+static void sharded_bus_forwards_between_shards() {
+    struct Hop : public EventHandler<Hop, ValueEvent> {
+        Hop(ShardedEventBus& sharded, std::size_t shard) : EventHandler(sharded.get_shard(shard)), sharded(sharded) { }
+        bool handle(const Event& event) {
+            auto value = static_cast<const ValueEvent&>(event).value;
+            if (value > 0) {
+                sharded.post(static_cast<std::uint64_t>(value), ValueEvent(value - 1));
+            }
+            calls++;
+            return false;
+        }
+        ShardedEventBus& sharded;
+        std::atomic<long> calls { 0 };
+    };
+    constexpr int SESSIONS = 200;
+    constexpr int HOPS = 5;
+    ShardedEventBus sharded(3);
+    std::vector<std::unique_ptr<Hop>> hops;
+    for (std::size_t i = 0; i < sharded.get_shard_count(); i++) {
+        hops.push_back(std::make_unique<Hop>(sharded, i));
+    }
+    sharded.start();
+    for (int i = 0; i < SESSIONS; i++) {
+        while (!sharded.post(static_cast<std::uint64_t>(i), ValueEvent(HOPS))) {
+            std::this_thread::yield();
+        }
+    }
+    auto total = [&]() {
+        long calls = 0;
+        for (auto& hop : hops) {
+            calls += hop->calls;
+        }
+        return calls;
+    };
+    while (total() < SESSIONS * (HOPS + 1)) {
+        std::this_thread::yield();
+    }
+    sharded.stop();
+    CHECK(total() == SESSIONS * (HOPS + 1));
+}
+
+// a handler that keeps posting to its own shard must not keep stop from returning
+static void sharded_bus_stops_under_self_posts() {
+    struct Echo : public EventHandler<Echo, ValueEvent> {
+        explicit Echo(ShardedEventBus& sharded) : EventHandler(sharded.get_shard(0)), sharded(sharded) { }
+        bool handle(const Event& event) {
+            sharded.post(0, ValueEvent(static_cast<const ValueEvent&>(event).value));
+            calls++;
+            return false;
+        }
+        ShardedEventBus& sharded;
+        std::atomic<long> calls { 0 };
+    };
+    ShardedEventBus sharded(1);
+    Echo echo(sharded);
+    sharded.start();
+    sharded.post(0, ValueEvent(1));
+    while (echo.calls < 1000) {
+        std::this_thread::yield();
+    }
+    sharded.stop();
+    CHECK(!sharded.is_running());
+}
+
+// handlers that disconnect themselves while being called, one at a time and in a batch
+static void handlers_disconnect_themselves() {
+    struct Once : public EventHandler<Once, ValueEvent> {
+        using EventHandler::EventHandler;
+        bool handle(const Event&) {
+            calls++;
+            disconnect();
+            return false;
+        }
+        void handle_batch(std::span<const ValueEvent> events) override {
+            calls += static_cast<int>(events.size());
+            disconnect();
+        }
+        int calls { 0 };
+    };
+    EventBus bus;
+    Once first(bus);
+    Once second(bus);
+    bus.emplace<ValueEvent>(1);
+    bus.emplace<ValueEvent>(2);
+    bus.process_queue();
+    CHECK(first.calls == 1 && second.calls == 1);
+
+    EventBus batched;
+    Once batch(batched);
+    batched.emplace<ValueEvent>(1);
+    batched.emplace<ValueEvent>(2);
+    batched.process_queue_batched();
+    CHECK(batch.calls == 2 && !batch.is_connected());
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+    CHECK(bus.get_stats().event_types[event_type_id<ValueEvent>].calls.invocations == 2);
+    CHECK(batched.get_stats().event_types[event_type_id<ValueEvent>].calls.invocations == 1);
+#endif
+}
+
+// a callable may drop its own subscription - its captures live until dispatch is over
+static void token_reset_inside_its_callable() {
+    EventBus bus;
+    SubscriptionToken small;
+    SubscriptionToken large;
+    auto payload = std::make_shared<std::string>("captured by the callable");
+    int calls = 0;
+    small = bus.subscribe<ValueEvent>([&, payload](const ValueEvent&) {
+        small.reset();
+        calls += payload->empty() ? 100 : 1;
+    });
+    std::array<char, 256> padding {};
+    large = bus.subscribe<ValueEvent>([&, padding](const ValueEvent&) {
+        large.reset();
+        calls += 1 + padding[0];
+    });
+    bus.emplace<ValueEvent>(1);
+    bus.emplace<ValueEvent>(2);
+    bus.process_queue();
+    CHECK(calls == 2);
+    CHECK(!small.is_subscribed() && !large.is_subscribed());
+    CHECK(payload.use_count() == 1);
+}
+
+// a handler draining the queue it is called from must not see its own event again
+static void nested_process_queue_returns_right_away() {
+    struct Nested : public EventHandler<Nested, ValueEvent> {
+        using EventHandler::EventHandler;
+        bool handle(const Event& event) {
+            seen.push_back(static_cast<const ValueEvent&>(event).value);
+            get_bus().process_queue();
+            CHECK(get_bus().process_queue(1) == 0);
+            return false;
+        }
+        void handle_batch(std::span<const ValueEvent> events) override {
+            for (auto& event : events) {
+                seen.push_back(event.value);
+            }
+            get_bus().push_to_queue(ValueEvent(0));
+            get_bus().process_queue_batched();
+        }
+        std::vector<int> seen;
+    };
+    for (auto doubleBuffered : { false, true }) {
+        EventBus bus;
+        bus.set_double_buffered(doubleBuffered);
+        Nested handler(bus);
+        bus.emplace<ValueEvent>(1);
+        bus.emplace<ValueEvent>(2);
+        bus.process_queue();
+        CHECK((handler.seen == std::vector<int> { 1, 2 }));
+    }
+    EventBus batched;
+    Nested handler(batched);
+    batched.emplace<ValueEvent>(1);
+    batched.emplace<ValueEvent>(2);
+    batched.process_queue_batched();
+    CHECK((handler.seen == std::vector<int> { 1, 2 }));
+}
+
+// higher lanes go first, but a waiting lower lane gets an event in after STARVATION_LIMIT (32) higher ones
+static void priority_lanes_preempt_without_starving() {
+    EventBus bus;
+    std::vector<int> seen;
+    auto token = bus.subscribe<ValueEvent>([&seen](const ValueEvent& event) {
+        seen.push_back(event.value);
+    });
+    bus.push_to_queue(ValueEvent(-1), EventPriority::Low);
+    bus.push_to_queue(ValueEvent(1), EventPriority::Normal);
+    bus.push_to_queue(ValueEvent(2), EventPriority::Critical);
+    bus.process_queue();
+    CHECK((seen == std::vector<int> { 2, 1, -1 }));
+
+    seen.clear();
+    bus.push_to_queue(ValueEvent(-1), EventPriority::Low);
+    for (int i = 0; i < 40; i++) {
+        bus.push_to_queue(ValueEvent(i), EventPriority::High);
+    }
+    bus.process_queue();
+    CHECK(seen.size() == 41 && seen[32] == -1);
+    CHECK(seen[31] == 31 && seen[33] == 32 && seen.back() == 39);
+}
+
+// coalesced pushes merge into the event waiting in their lane until dispatch reaches it
+static void coalescing_merges_into_waiting_events() {
+    EventPool<LargeEvent> pool(2, LargeEvent());
+    EventBus bus;
+    std::vector<int> seen;
+    auto values = bus.subscribe<ValueEvent>([&seen](const ValueEvent& event) {
+        seen.push_back(event.value);
+    });
+    bus.set_coalescing<ValueEvent>(CoalescePolicy::KeepLast);
+    bus.push_to_queue(ValueEvent(1));
+    bus.push_to_queue(ValueEvent(2));
+    bus.push_to_queue(ValueEvent(3), EventPriority::High);
+    bus.push_to_queue(ValueEvent(4));
+    bus.process_queue();
+    bus.push_to_queue(ValueEvent(5));
+    bus.process_queue();
+    CHECK((seen == std::vector<int> { 3, 4, 5 }));
+
+    seen.clear();
+    bus.set_coalescing<ValueEvent>([](ValueEvent& waiting, ValueEvent&& incoming) {
+        waiting.value += incoming.value;
+    });
+    for (int i = 1; i <= 4; i++) {
+        bus.emplace<ValueEvent>(i);
+    }
+    bus.process_queue();
+    CHECK((seen == std::vector<int> { 10 }));
+
+    // a merged pooled event goes back to its pool right away, the waiting one once dispatched
+    int large = 0;
+    auto larges = bus.subscribe<LargeEvent>([&large](const LargeEvent& event) {
+        large = event.value;
+    });
+    bus.set_coalescing<LargeEvent>(CoalescePolicy::KeepLast);
+    for (int i = 1; i <= 3; i++) {
+        auto event = pool.acquire();
+        CHECK(event != nullptr);
+        event->value = i;
+        bus.submit(event);
+    }
+    bus.process_queue();
+    CHECK(large == 3);
+    auto first = pool.acquire();
+    auto second = pool.acquire();
+    CHECK(first != nullptr && second != nullptr);
+    pool.release(first);
+    pool.release(second);
+}
+
+// coalescing must let go of events that left the queue another way than dispatch
+static void coalescing_forgets_swapped_and_dropped_events() {
+    // pushes made by handlers belong to the next frame, even if an event of their type waits in this one
+    EventBus buffered;
+    buffered.set_double_buffered(true);
+    buffered.set_coalescing<ValueEvent>(CoalescePolicy::KeepLast);
+    std::vector<int> seen;
+    auto values = buffered.subscribe<ValueEvent>([&seen](const ValueEvent& event) {
+        seen.push_back(event.value);
+    });
+    auto larges = buffered.subscribe<LargeEvent>([&buffered](const LargeEvent&) {
+        buffered.push_to_queue(ValueEvent(2));
+    });
+    buffered.emplace<LargeEvent>();
+    buffered.push_to_queue(ValueEvent(1));
+    buffered.process_queue();
+    CHECK((seen == std::vector<int> { 1 }));
+    buffered.process_queue();
+    CHECK((seen == std::vector<int> { 1, 2 }));
+
+    // an evicted waiting event takes no more merges
+    EventPool<LargeEvent> pool(2, LargeEvent());
+    EventBus bounded(2, OverflowPolicy::DropOldest);
+    bounded.set_coalescing<ValueEvent>(CoalescePolicy::KeepLast);
+    seen.clear();
+    auto bounded_values = bounded.subscribe<ValueEvent>([&seen](const ValueEvent& event) {
+        seen.push_back(event.value);
+    });
+    auto bounded_larges = bounded.subscribe<LargeEvent>([&seen](const LargeEvent& event) {
+        seen.push_back(event.value);
+    });
+    bounded.push_to_queue(ValueEvent(1));
+    for (int i = 10; i <= 11; i++) {
+        auto event = pool.acquire();
+        event->value = i;
+        bounded.submit(event);
+    }
+    bounded.push_to_queue(ValueEvent(2));
+    bounded.process_queue();
+    CHECK((seen == std::vector<int> { 11, 2 }));
+    CHECK(bounded.get_dropped_events() == 2);
+}
+
+// handlers run by priority, and subscriptions made during dispatch that belong in the middle of a table wait
+// for the next event
+static void priority_order_survives_registration_during_dispatch() {
+    EventBus bus;
+    std::string calls;
+    SubscriptionToken early;
+    SubscriptionToken middle;
+    SubscriptionToken last;
+    auto low = bus.subscribe<ValueEvent>([&calls](const ValueEvent&) {
+        calls += 'a';
+    }, 0);
+    auto high = bus.subscribe<ValueEvent>([&](const ValueEvent& event) {
+        calls += 'b';
+        if (event.value == 1) {
+            middle = bus.subscribe<ValueEvent>([&calls](const ValueEvent&) {
+                calls += 'c';
+            }, 5);
+            early = bus.subscribe<ValueEvent>([&calls](const ValueEvent&) {
+                calls += 'd';
+            }, 20);
+            // unsubscribed before it was ever inserted
+            early.reset();
+            last = bus.subscribe<ValueEvent>([&calls](const ValueEvent&) {
+                calls += 'e';
+            }, -5);
+        }
+    }, 10);
+    auto equal = bus.subscribe<ValueEvent>([&calls](const ValueEvent&) {
+        calls += 'f';
+    }, 10);
+    auto stopping = bus.subscribe<ValueEvent>([&calls](const ValueEvent& event) {
+        calls += 's';
+        return event.value == 3;
+    }, 7);
+    for (int value = 1; value <= 3; value++) {
+        bus.emplace<ValueEvent>(value);
+        bus.process_queue();
+        calls += '|';
+    }
+    CHECK(calls == "bfsa|bfscae|bfs|");
+    CHECK(!early.is_subscribed() && middle.is_subscribed());
+}
+
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+// the numbers get_stats reports, and reset_stats clearing them
+static void instrumentation_records_dispatch() {
+    LatencyHistogram histogram;
+    for (std::uint64_t nanoseconds = 1; nanoseconds <= 1000; nanoseconds++) {
+        histogram.record(nanoseconds);
+    }
+    // buckets above 16ns are 12.5% wide, and no percentile goes past the largest value
+    auto median = histogram.percentile(50);
+    CHECK(median >= 500 && median <= 563);
+    auto tail = histogram.percentile(99);
+    CHECK(tail >= 990 && tail <= 1000);
+    CHECK(histogram.percentile(100) == 1000 && histogram.max() == 1000);
+    CHECK(histogram.percentile(0) == 1);
+    LatencyHistogram exact;
+    exact.record(5);
+    CHECK(exact.percentile(50) == 5 && exact.count() == 1);
+
+    EventBus bus;
+    auto first = bus.subscribe<ValueEvent>([](const ValueEvent& event) {
+        return event.value % 2 == 1;
+    }, 1);
+    auto second = bus.subscribe<ValueEvent>([](const ValueEvent&) { });
+    for (int value = 1; value <= 4; value++) {
+        bus.emplace<ValueEvent>(value);
+    }
+    bus.process_queue();
+    auto stats = bus.get_stats();
+    // depth sampled on every push - 1, 2, 3 and 4 events waiting
+    CHECK(stats.queue_depth.peak == 4 && stats.queue_depth.samples == 4);
+    CHECK(stats.queue_depth.average() == 2.5);
+    auto& values = stats.event_types[event_type_id<ValueEvent>];
+    CHECK(values.dispatched == 4);
+    CHECK(values.calls.invocations == 6 && values.calls.stopped_propagation == 2);
+    CHECK(values.calls.time.count() == 6);
+    CHECK(stats.handlers.size() == 2);
+    for (auto& handler : stats.handlers) {
+        auto stopping = handler.calls.stopped_propagation > 0;
+        CHECK(handler.calls.invocations == (stopping ? 4u : 2u));
+        CHECK(!stopping || handler.calls.stopped_propagation == 2);
+    }
+
+    bus.reset_stats();
+    stats = bus.get_stats();
+    CHECK(stats.queue_depth.peak == 0 && stats.queue_depth.average() == 0.0);
+    CHECK(stats.event_types[event_type_id<ValueEvent>].dispatched == 0);
+    CHECK(stats.event_types[event_type_id<ValueEvent>].calls.invocations == 0);
+    for (auto& handler : stats.handlers) {
+        CHECK(handler.calls.invocations == 0 && handler.calls.time.count() == 0);
+    }
+}
+#endif
+
+int main() {
+    stream_rewinds_around_large_records();
+    bounded_bus_handles_large_events();
+    bounded_bus_applies_its_overflow_policy();
+    bounded_bus_keeps_its_capacity_across_modes();
+    multi_producer_queue_delivers_everything();
+    concurrent_registration_while_dispatching();
+    concurrent_registration_waits_only_for_the_running_call();
+    concurrent_registration_skips_handlers_destroyed_during_dispatch();
+    parallel_handlers_run_on_the_pool();
+    sharded_bus_forwards_between_shards();
+    sharded_bus_stops_under_self_posts();
+    handlers_disconnect_themselves();
+    token_reset_inside_its_callable();
+    nested_process_queue_returns_right_away();
+    priority_order_survives_registration_during_dispatch();
+    priority_lanes_preempt_without_starving();
+    coalescing_merges_into_waiting_events();
+    coalescing_forgets_swapped_and_dropped_events();
+#ifdef EVENT_SYSTEM_INSTRUMENTATION
+    instrumentation_records_dispatch();
+#endif
+    if (g_failures > 0) {
+        std::printf("%d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "event_system/type_list.h"
+
+// events the tests dispatch, defined in event_system_tests.cpp
+struct ValueEvent;
+struct LargeEvent;
+using EventRegistry = TypeList<ValueEvent, LargeEvent>;